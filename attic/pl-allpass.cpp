@@ -15,6 +15,10 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../dsp/BlockNoise.hpp"
+#include "../dsp/FdnReverb.hpp"
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -23,8 +27,6 @@ public:
 
     PluckedString(float frq=440)
         : mAmp(1), mDur(2),
-          //comb(1./100, 1,0),
-          mallpass(500,1000),
           env(0.1), fil(2), mdelay(1./27.5, 1./frq){
         decay(1.0);
         mAmpEnv.curve(4); // make segments lines
@@ -40,8 +42,6 @@ public:
         mAmpEnv.lengths()[1] = v;
         return *this;
     }
-    //PluckedString& freq(float v){mallpass.freq(v); return *this; }
-    //PluckedString& width(float v){mallpass.width(v); return *this; }
     PluckedString& pan(float v){ mPan.pos(v); return *this; }
     void reset(){ env.reset(); }
 
@@ -65,8 +65,7 @@ public:
 
     virtual void onProcess(AudioIOData& io) override {
         while(io()){
-            float s = (*this)() * mAmpEnv() * mAmp;
-            float s1 = mallpass(s);
+            float s1 = (*this)() * mAmpEnv() * mAmp;
             float s2;
             mEnvFollow(s1);
             mPan(s1, s1,s2);
@@ -85,18 +84,28 @@ protected:
     float mAmp;
     float mDur;
     Pan<> mPan;
-    NoiseWhite<> noise;
+    BlockNoise noise;
     Decay<> env;
     MovingAvg<> fil;
     Delay<float, ipl::Trunc> mdelay;
     Env<2> mAmpEnv;
-    AllPass2<> mallpass;
     EnvFollow<> mEnvFollow;
 };
 
+SynthSequencer s;
+
+// One reverb for all plucks, on the mix of the sequencer
+FdnReverb<8> reverb;
+
+void audioCB(AudioIOData& io){
+    DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+    s.render(io);
+    reverb.process(io.outBuffer(0), io.outBuffer(1),
+                   io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+}
+
 int main(){
 
-    SynthSequencer s;
     s.add<PluckedString>( 0  ).set(6.5, 110,  0.3, .005, 0);
     s.add<PluckedString>( 3.5  ).set(6.5, 110,  0.3, .005, 0);
     s.add<PluckedString>( 6.5).set(6.5, 233,  0.3, .1, 0);
@@ -105,8 +114,11 @@ int main(){
 //    s.add(Func(thirdPluck, &PluckedString::freq, 440)).dt(14);
 
     AudioIO io;
-    io.initWithDefaults(s.audioCB, &s, true, false);
+    io.initWithDefaults(audioCB, nullptr, true, false);
     Domain::master().spu(io.framesPerSecond());
+    reverb.init(io.framesPerSecond());
+    reverb.matrix(FdnReverb<8>::HOUSEHOLDER);
+    reverb.decay(1.5);
     io.start();
     printf("\nPress 'enter' or Ctrl-C to quit...\n");
     while (io.isRunning()) {
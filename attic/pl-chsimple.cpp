@@ -15,6 +15,9 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../dsp/BlockNoise.hpp"
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -67,6 +70,8 @@ public:
     }
 
     virtual void onProcess(AudioIOData& io) override {
+        // The sequencer owns the audio callback, so each voice flushes subnormals
+        DenormalGuard noDenormals;
         while(io()){
             float s = (*this)() * mAmpEnv() * mAmp;
             float s1 = chrA3(chrA2(chrA1(s)));
@@ -90,7 +95,7 @@ protected:
     float mAmp;
     float mDur;
     Pan<> mPan;
-    NoiseWhite<> noise;
+    BlockNoise noise;
     Decay<> env;
     MovingAvg<> fil;
     Delay<float, ipl::Trunc> delay;
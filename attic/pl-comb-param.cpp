@@ -15,9 +15,15 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../dsp/BlockNoise.hpp"
+#include "../dsp/CombReverb.hpp"
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
+// Comb delay memory for all voices, reserved in main()
+DelayArena delayArena;
 
 class PluckedString : public SynthVoice {
 public:
@@ -25,11 +31,13 @@ public:
     PluckedString(float frq=440)
         :   mAmp(1), mDur(2),
         //comb(1./100, 1,0),
-        mcomb(1./100 + 1./10000, 0,-0.99),
+        mCombDelay(1./100 + 1./10000), mFfd(0), mFbk(-0.99),
         env(0.1), fil(2), mdelay(1./27.5, 1./frq){
         decay(1.0);
         mAmpEnv.curve(4); // make segments lines
         mAmpEnv.levels(1,1,0);
+        mcomb.numCombs(1);
+        mcomb.ipolType(CombReverb::CUBIC);
     }
 
     PluckedString& freq(float v){mdelay.freq(v); return *this; }
@@ -41,9 +49,9 @@ public:
         mAmpEnv.lengths()[1] = v;
         return *this;
     }
-    PluckedString& delay(float v){mcomb.delay(v); return *this; }
-    PluckedString& ffd(float v){mcomb.ffd(v); return *this; }
-    PluckedString& fbk(float v){mcomb.fbk(v); return *this; }
+    PluckedString& delay(float v){mCombDelay = v; return *this; }
+    PluckedString& ffd(float v){mFfd = v; mcomb.feeds(0, mFfd, mFbk); return *this; }
+    PluckedString& fbk(float v){mFbk = v; mcomb.feeds(0, mFfd, mFbk); return *this; }
     PluckedString& pan(float v){ mPan.pos(v); return *this; }
     void reset(){ env.reset(); }
 
@@ -66,12 +74,13 @@ public:
     }
 
     virtual void onProcess(AudioIOData& io) override {
+        // The sequencer owns the audio callback, so each voice flushes subnormals
+        DenormalGuard noDenormals;
+        // Comb parameters changed since the last block take effect here
+        if(!mLeased){ mcomb.release(); free(); return; } // arena was exhausted
+        mcomb.beginBlock(io.framesPerBuffer());
         while(io()){
-            //comb.feeds(0,-0.7);
-            //comb.feeds(0,-0.99);
             float s = (*this)() * mAmpEnv() * mAmp;
-            mcomb.ipolType(ipl::CUBIC);
-            //comb.delay(1./100 + 1./10000);
             float s1 = mcomb(s);
             float s2;
             mEnvFollow(s1);
@@ -79,24 +88,32 @@ public:
             io.out(0) += s1;
             io.out(1) += s2;
         }
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)){
+            mcomb.release();
+            free();
+        }
     }
 
     virtual void onTriggerOn() override {
+        float spu = Domain::master().spu();
+        mLeased = mcomb.lease(delayArena, unsigned(0.1 * spu));
+        mcomb.feeds(0, mFfd, mFbk);
+        mcomb.delay(0, mCombDelay * spu);
         mAmpEnv.reset();
     }
 
 protected:
     float mAmp;
     float mDur;
+    float mCombDelay, mFfd, mFbk;
     Pan<> mPan;
-    NoiseWhite<> noise;
+    BlockNoise noise;
     Decay<> env;
     MovingAvg<> fil;
     Delay<float, ipl::Trunc> mdelay;
     Env<2> mAmpEnv;
-    //Comb<float, ipl::Any> comb;
-    Comb<float, ipl::Switchable> mcomb;
+    CombReverb mcomb;
+    bool mLeased = false;
     EnvFollow<> mEnvFollow;
 };
 
@@ -113,6 +130,8 @@ int main(){
     AudioIO io;
     io.initWithDefaults(s.audioCB, &s, true, false);
     Domain::master().spu(io.framesPerSecond());
+    // One 0.1 s comb for each of the five plucks
+    delayArena.reserve(unsigned(0.1 * io.framesPerSecond()) + 2, 5);
     io.start();
     printf("\nPress 'enter' or Ctrl-C to quit...\n");
     while (io.isRunning()) {
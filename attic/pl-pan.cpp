@@ -15,6 +15,9 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../dsp/BlockNoise.hpp"
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -65,6 +68,8 @@ public:
     }
 
     virtual void onProcess(AudioIOData& io) override {
+        // The sequencer owns the audio callback, so each voice flushes subnormals
+        DenormalGuard noDenormals;
         while(io()){
             mPan.pos(mPanEnv());
             float s1 =  (*this)() * mAmpEnv() * mAmp;
@@ -91,7 +96,7 @@ protected:
     float mDur;
     float mPanRise;
     Pan<> mPan;
-    NoiseWhite<> noise;
+    BlockNoise noise;
     Decay<> env;
     MovingAvg<> fil;
     Delay<float, ipl::Trunc> delay;
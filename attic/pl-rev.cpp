@@ -15,6 +15,10 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../dsp/BlockNoise.hpp"
+#include "../dsp/FdnReverb.hpp"
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -23,12 +27,6 @@ public:
 
     PluckedString(float frq=440)
     :   mAmp(1),
-        comb(0.4, 1./100, 1,0),
-        comb2(0.4, 1./200, 1,0),
-        comb3(0.4, 1./300, 1,0),
-        comb4(0.4, 1./400, 1,0),
-        mallpass(1000,100),
-        mallpass2(500,100),
         env(0.1), fil(2), delay(1./27.5, 1./frq){
         decay(1.0);
         mAmpEnv.curve(4); // make segments lines
@@ -67,30 +65,8 @@ public:
     }
 
     void onProcess(AudioIOData& io){
-
         while(io()){
-            //comb.feeds(0,-0.7);
-            comb.feeds(0,-0.99);
-            comb2.feeds(1,0);
-            comb3.feeds(1,0);
-            comb4.feeds(1,0);
-            float s = (*this)() * mAmpEnv() * mAmp;
-            comb.ipolType(ipl::CUBIC);
-            comb2.ipolType(ipl::CUBIC);
-            comb3.ipolType(ipl::CUBIC);
-            comb4.ipolType(ipl::CUBIC);
-            comb.maxDelay(0.4);
-            comb2.maxDelay(0.4);
-            comb3.maxDelay(0.4);
-            comb4.maxDelay(0.4);
-            comb.delay(1./100 + 1./10000);
-            comb2.delay(1./200 + 1./10000);
-            comb3.delay(1./300 + 1./10000);
-            comb4.delay(1./400 + 1./10000);
-            float s1 = (comb(s) + comb2(s) + comb3(s) + comb4(s));
-            s1 += mallpass(s);
-            s1 += mallpass2(s);
-            //float s1 = comb(s);
+            float s1 = (*this)() * mAmpEnv() * mAmp;
             float s2;
             mPan(s1, s1,s2);
             mEnvFollow(s1);
@@ -108,28 +84,40 @@ protected:
     float mAmp;
 //    float mDur;
     Pan<> mPan;
-    NoiseWhite<> noise;
+    BlockNoise noise;
     Decay<> env;
     MovingAvg<> fil;
     Delay<float, ipl::Trunc> delay;
     Env<2> mAmpEnv;
-    //Comb<float, ipl::Any> comb;
-    Comb<float, ipl::Linear> comb, comb2,comb3,comb4;
-    AllPass2<> mallpass, mallpass2;
     EnvFollow<> mEnvFollow;
 };
 
+SynthSequencer s;
+
+// One reverb for all plucks, on the mix of the sequencer
+FdnReverb<16> reverb;
+
+void audioCB(AudioIOData& io){
+    DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+    s.render(io);
+    reverb.process(io.outBuffer(0), io.outBuffer(1),
+                   io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+}
+
 int main(){
 
-    SynthSequencer s;
     s.add<PluckedString>( 0  ).set(6.5, 110,  0.3, .005, -1);
     s.add<PluckedString>( 3.5).set(6.5, 233,  0.3, .1, 0);
     PluckedString &thirdPluck = s.add<PluckedString>( 6.5).set(6.5, 329,  0.7, .0001, 1);
 //    s.add(Func(thirdPluck, &PluckedString::freq, 440)).dt(8);
 
     AudioIO io;
-    io.initWithDefaults(s.audioCB, &s, true, false);
+    io.initWithDefaults(audioCB, nullptr, true, false);
     Domain::master().spu(io.framesPerSecond());
+    reverb.init(io.framesPerSecond());
+    reverb.decay(3.0);
+    reverb.damping(5000);
+    reverb.mix(0.4);
     io.start();
     printf("\nPress 'enter' or Ctrl-C to quit...\n");
     while (io.isRunning()) {
@@ -14,6 +14,8 @@
 #include "al/core/io/al_AudioIO.hpp"
 #include "al/util/scene/al_SynthSequencer.hpp"
 
+#include "../engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -62,6 +64,8 @@ public:
 
     //
     virtual void onProcess(AudioIOData& io) override {
+        // The sequencer owns the audio callback, so each voice flushes subnormals
+        DenormalGuard noDenormals;
 
         while(io()){
             // mix oscillator with noise
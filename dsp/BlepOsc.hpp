@@ -0,0 +1,118 @@
+#ifndef SYNTHTUTORIAL_DSP_BLEPOSC_HPP
+#define SYNTHTUTORIAL_DSP_BLEPOSC_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           BlepOsc.hpp
+    Description:    Band-limited saw, square, pulse and triangle without
+                    tables.
+
+    The table oscillators read 2048-sample tables built from a fixed number
+    of harmonics, and every app keeps its own copies. BlepOsc computes the
+    waveform from its phase instead. The trivial waveform has a jump (saw,
+    square, pulse) or a corner (triangle) that aliases; near each jump a
+    two-sample polynomial residual (PolyBLEP) is subtracted, and near each
+    corner its integral (PolyBLAMP). This removes most of the aliasing at
+    the cost of a few multiplies per discontinuity and no memory beyond the
+    phase, so any number of voices share nothing.
+
+    Output is in [-1, 1]. The pulse is offset so it has no DC at any width,
+    which would put a narrow pulse's peak near 2, so it is also scaled by
+    1/(2 max(w, 1-w)): its peak is always 1, and its level at width w the
+    same as at 1-w.
+*/
+
+#include "Gamma/Domain.h"
+
+class BlepOsc : public gam::DomainObserver {
+public:
+
+    enum Wave { SAW, SQUARE, PULSE, TRIANGLE };
+
+    /// @param[in] frq  frequency
+    /// @param[in] w    waveform
+    BlepOsc(float frq=440, Wave w=SAW): mWave(w) { freq(frq); }
+
+    /// Set frequency
+    void freq(float v){ mFreq = v; mInc = float(v * ups()); }
+    float freq() const { return mFreq; }
+
+    /// Set waveform
+    void wave(Wave w){ mWave = w; }
+    Wave wave() const { return mWave; }
+
+    /// Set pulse width in (0, 1); SQUARE always uses 0.5
+    void width(float v){
+        mWidth = v < 0.01f ? 0.01f : (v > 0.99f ? 0.99f : v);
+        mPulseScale = 0.5f / (mWidth > 0.5f ? mWidth : 1.f - mWidth);
+    }
+    float width() const { return mWidth; }
+
+    /// Set phase in [0, 1)
+    void phase(float v){ mPhase = v - float(int(v)); }
+
+    /// Generate next sample
+    float operator()(){
+        const float t = mPhase, dt = mInc;
+        float y;
+        switch(mWave){
+        case SAW:
+            y = 2.f*t - 1.f - blep(t, dt);
+            break;
+        case SQUARE:
+        case PULSE: {
+            float w = mWave == SQUARE ? 0.5f : mWidth;
+            y = t < w ? 1.f : -1.f;
+            y += blep(t, dt) - blep(wrap(t - w + 1.f), dt);
+            y -= 2.f*w - 1.f;       // remove DC
+            if(mWave == PULSE) y *= mPulseScale;    // back into [-1, 1]
+            } break;
+        default: // TRIANGLE
+            y = t < 0.5f ? 4.f*t - 1.f : 3.f - 4.f*t;
+            // Slope turns up at phase 0 and down at phase 1/2
+            y += 4.f * dt * (blamp(t, dt) - blamp(wrap(t + 0.5f), dt));
+            break;
+        }
+        mPhase = wrap(t + dt);
+        return y;
+    }
+
+    void onDomainChange(double){ freq(mFreq); }
+
+    /// PolyBLEP residual of a unit step at phase 0
+    static float blep(float t, float dt){
+        if(t < dt){
+            t /= dt;
+            return t + t - t*t - 1.f;
+        }
+        if(t > 1.f - dt){
+            t = (t - 1.f) / dt;
+            return t*t + t + t + 1.f;
+        }
+        return 0.f;
+    }
+
+    /// PolyBLAMP residual of a unit change of slope at phase 0
+    static float blamp(float t, float dt){
+        if(t < dt){
+            t = t / dt - 1.f;
+            return -1.f/3.f * t*t*t;
+        }
+        if(t > 1.f - dt){
+            t = (t - 1.f) / dt + 1.f;
+            return 1.f/3.f * t*t*t;
+        }
+        return 0.f;
+    }
+
+private:
+    Wave mWave;
+    float mFreq = 440, mInc = 0;
+    float mPhase = 0;
+    float mWidth = 0.5;
+    float mPulseScale = 1;      // 1 / (2 max(w, 1-w))
+
+    static float wrap(float t){ return t >= 1.f ? t - 1.f : t; }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef SYNTHTUTORIAL_DSP_BLOCKNOISE_HPP
+#define SYNTHTUTORIAL_DSP_BLOCKNOISE_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           BlockNoise.hpp
+    Description:    White noise generated a block at a time.
+
+    The generator runs kLanes independent xorshift32 streams side by side.
+    The lanes have no dependency on each other, so the fill loop is
+    vectorized by the compiler. A BlockNoise can either fill a buffer
+    directly or be pulled one sample at a time like gam::NoiseWhite, in
+    which case it refills an internal block of kBlock samples as needed.
+
+    Every instance gets its own seed. Seeds are handed out from a global
+    sequence so a program that creates its voices in the same order gets
+    the same noise. Call seed() to set one explicitly.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+class BlockNoise {
+public:
+
+    static const unsigned kLanes = 8;     ///< Number of parallel generators
+    static const unsigned kBlock = 64;    ///< Size of internal block (multiple of kLanes)
+
+    /// @param[in] seed     initial seed
+    BlockNoise(uint32_t seed = nextSeed()){ this->seed(seed); }
+
+    /// Reseed generator; the same seed always produces the same output
+    void seed(uint32_t v){
+        uint64_t s = v;
+        for(unsigned i=0; i<kLanes; ++i){
+            uint32_t x = uint32_t(splitMix(s) >> 32);
+            mState[i] = x ? x : 0x9E3779B9u;
+        }
+        mPos = kBlock;
+    }
+
+    /// Generate next sample in [-1, 1)
+    float operator()(){
+        if(mPos == kBlock){
+            fill(mBuf, kBlock);
+            mPos = 0;
+        }
+        return mBuf[mPos++];
+    }
+
+    /// Fill buffer with samples in [-1, 1)
+
+    /// This bypasses the internal block used by operator().
+    ///
+    void fill(float * dst, unsigned n){
+        while(n >= kLanes){
+            step(dst);
+            dst += kLanes; n -= kLanes;
+        }
+        if(n){
+            float tmp[kLanes];
+            step(tmp);
+            for(unsigned i=0; i<n; ++i) dst[i] = tmp[i];
+        }
+    }
+
+    /// Get a seed from the global seed sequence
+    static uint32_t nextSeed(){
+        static std::atomic<uint32_t> counter(0);
+        uint64_t s = counter.fetch_add(1, std::memory_order_relaxed);
+        return uint32_t(splitMix(s));
+    }
+
+protected:
+    uint32_t mState[kLanes];
+    float mBuf[kBlock];
+    unsigned mPos;
+
+    // Advance all lanes and write one sample per lane
+    void step(float * dst){
+        for(unsigned i=0; i<kLanes; ++i){
+            uint32_t x = mState[i];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            mState[i] = x;
+            // Put 23 random bits into the mantissa of a float in [2, 4)
+            uint32_t bits = (x >> 9) | 0x40000000u;
+            float f;
+            std::memcpy(&f, &bits, sizeof f);
+            dst[i] = f - 3.f;
+        }
+    }
+
+    static uint64_t splitMix(uint64_t& s){
+        uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef SYNTHTUTORIAL_DSP_COMBREVERB_HPP
+#define SYNTHTUTORIAL_DSP_COMBREVERB_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           CombReverb.hpp
+    Description:    Parallel bank of comb filters with deferred parameters.
+
+    Each comb has the same form as gam::Comb:
+
+        v[n] = x[n] + fbk * v[n-d]
+        y[n] = v[n-d] + ffd * v[n]
+
+    and the outputs of all combs are summed. Setters only record the new
+    value and mark the bank dirty. The values are applied by beginBlock(),
+    once per block, and a delay change glides to its new length over the
+    block instead of jumping, so a sweep does not click. Delay memory is
+    leased from a DelayArena when the voice starts.
+*/
+
+#include "DelayArena.hpp"
+
+class CombReverb {
+public:
+
+    static const unsigned kMaxCombs = 8;
+
+    enum Ipol { TRUNC, LINEAR, CUBIC };
+
+    /// Set number of combs in use
+    CombReverb& numCombs(unsigned n){
+        mPending.num = n < kMaxCombs ? n : kMaxCombs;
+        mDirty = true; return *this;
+    }
+
+    /// Set delay of comb i in samples
+    CombReverb& delay(unsigned i, float samples){
+        if(i < kMaxCombs){ mPending.delay[i] = samples; mDirty = true; }
+        return *this;
+    }
+
+    /// Set feedforward and feedback amounts of comb i
+    CombReverb& feeds(unsigned i, float ffd, float fbk){
+        if(i < kMaxCombs){
+            mPending.ffd[i] = ffd; mPending.fbk[i] = fbk; mDirty = true;
+        }
+        return *this;
+    }
+
+    /// Set interpolation used to read the delays
+    CombReverb& ipolType(Ipol v){ mPending.ipol = v; mDirty = true; return *this; }
+
+    /// Lease delay memory for all combs
+
+    /// @param[in] arena        arena to lease from
+    /// @param[in] maxDelay     longest delay in samples
+    /// \returns false if the arena ran out of lines; combs without a
+    /// line are skipped, and the caller should release() and give up
+    bool lease(DelayArena& arena, unsigned maxDelay){
+        bool ok = true;
+        for(unsigned i=0; i<mPending.num; ++i){
+            bool leased = mLines[i].lease(arena, maxDelay + 2);
+            if(leased) mLines[i].zero();
+            ok &= leased;
+        }
+        mFirst = true;
+        mDirty = true;
+        return ok;
+    }
+
+    /// Return delay memory to the arena
+    void release(){
+        for(auto& l : mLines) l.release();
+    }
+
+    /// Apply pending parameters; call once before each block of n samples
+    void beginBlock(unsigned n){
+        if(!mDirty) return;
+        mDirty = false;
+        mActive.num = mPending.num;
+        mActive.ipol = mPending.ipol;
+        for(unsigned i=0; i<mActive.num; ++i){
+            mActive.ffd[i] = mPending.ffd[i];
+            mActive.fbk[i] = mPending.fbk[i];
+            mActive.delay[i] = mPending.delay[i];
+            if(mFirst || 0 == n){
+                mLines[i].delay(mActive.delay[i]);
+                mGlide[i] = 0.f;
+            }
+            else {
+                mGlide[i] = (mActive.delay[i] - mLines[i].delay()) / float(n);
+                mGlideCount = n;
+            }
+        }
+        mFirst = false;
+    }
+
+    /// Filter next sample
+    float operator()(float in){
+        bool gliding = mGlideCount > 0;
+        if(gliding) --mGlideCount;
+        float sum = 0.f;
+        for(unsigned i=0; i<mActive.num; ++i){
+            ArenaDelay& l = mLines[i];
+            if(!l.valid()) continue;
+            if(gliding) l.delay(l.delay() + mGlide[i]);
+            float oN;
+            switch(mActive.ipol){
+            case TRUNC:  oN = l.read(); break;
+            case LINEAR: oN = l.readLinear(); break;
+            default:     oN = l.readCubic(); break;
+            }
+            float v = in + oN * mActive.fbk[i];
+            l.write(v);
+            sum += oN + v * mActive.ffd[i];
+        }
+        // Land exactly on the target once the glide is over
+        if(gliding && 0 == mGlideCount){
+            for(unsigned i=0; i<mActive.num; ++i) mLines[i].delay(mActive.delay[i]);
+        }
+        return sum;
+    }
+
+private:
+    struct Params {
+        unsigned num = 1;
+        Ipol ipol = LINEAR;
+        float delay[kMaxCombs] = {};
+        float ffd[kMaxCombs] = {};
+        float fbk[kMaxCombs] = {};
+    };
+
+    Params mPending, mActive;
+    ArenaDelay mLines[kMaxCombs];
+    float mGlide[kMaxCombs] = {};
+    unsigned mGlideCount = 0;
+    bool mDirty = true;
+    bool mFirst = true;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SYNTHTUTORIAL_DSP_CONTROLRESON_HPP
+#define SYNTHTUTORIAL_DSP_CONTROLRESON_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           ControlReson.hpp
+    Description:    Two-pole resonator with control-rate coefficient updates.
+
+    gam::Reson recomputes its coefficients (an exp, a sin and a cos) every
+    time set() is called, which is every sample when the center frequency
+    and bandwidth are driven by envelopes. ControlReson::set() only latches
+    the target; the coefficients are computed once per control period and
+    linearly interpolated in between. Interpolating (c1, c2) is safe since
+    the stability region of a two-pole filter is convex.
+*/
+
+#include <cmath>
+
+#include "Gamma/Domain.h"
+
+template <class Tv=float, class Td=gam::DomainObserver>
+class ControlReson : public Td {
+public:
+
+    /// @param[in] frq      center frequency
+    /// @param[in] wid      bandwidth
+    /// @param[in] period   samples between coefficient updates
+    ControlReson(float frq=440, float wid=100, unsigned period=16)
+    :   mFrq(frq), mWid(wid)
+    {
+        this->period(period);
+        zero();
+    }
+
+    /// Set number of samples between coefficient updates
+    void period(unsigned n){ mPeriod = n ? n : 1; mInvPeriod = 1.f/mPeriod; }
+    unsigned period() const { return mPeriod; }
+
+    /// Set target center frequency and bandwidth
+
+    /// This is cheap and may be called every sample. The target is picked
+    /// up at the start of the next control period.
+    void set(float frq, float wid){ mFrq = frq; mWid = wid; }
+
+    /// Zero delay elements and jump to the current target on the next sample
+    void zero(){
+        mD1 = mD2 = Tv(0);
+        mCount = 0;
+        mJump = true;
+    }
+
+    /// Filter next sample
+    Tv operator()(Tv in){
+        if(0 == mCount) nextSegment();
+        --mCount;
+        Tv o = in*mGain + mD1*mC1 + mD2*mC2;
+        mD2 = mD1; mD1 = o;
+        mC1 += mDC1; mC2 += mDC2; mGain += mDGain;
+        return o;
+    }
+
+    /// Filter a block of samples in place
+    void process(Tv * buf, unsigned n){
+        while(n){
+            if(0 == mCount) nextSegment();
+            unsigned m = n < mCount ? n : mCount;
+            float c1 = mC1, c2 = mC2, g = mGain;
+            Tv d1 = mD1, d2 = mD2;
+            for(unsigned i=0; i<m; ++i){
+                Tv o = buf[i]*g + d1*c1 + d2*c2;
+                d2 = d1; d1 = o;
+                buf[i] = o;
+                c1 += mDC1; c2 += mDC2; g += mDGain;
+            }
+            mC1 = c1; mC2 = c2; mGain = g;
+            mD1 = d1; mD2 = d2;
+            mCount -= m; buf += m; n -= m;
+        }
+    }
+
+    void onDomainChange(double){ mJump = true; mCount = 0; }
+
+protected:
+    float mFrq, mWid;
+    float mC1 = 0, mC2 = 0, mGain = 0;        // current coefficients
+    float mDC1 = 0, mDC2 = 0, mDGain = 0;     // per-sample coefficient increments
+    Tv mD1, mD2;
+    unsigned mPeriod, mCount;
+    float mInvPeriod;
+    bool mJump;
+
+    // Compute coefficients for the latched target and ramp towards them
+    void nextSegment(){
+        float ups = this->ups();
+        float rad = std::exp(float(-M_PI) * mWid * ups);
+        float theta = float(2*M_PI) * mFrq * ups;
+        float c1 = 2.f * rad * std::cos(theta);
+        float c2 = -rad * rad;
+        // normalize to roughly unit gain at resonance
+        float gain = (1.f - rad*rad) * std::sin(theta);
+
+        if(mJump){
+            mC1 = c1; mC2 = c2; mGain = gain;
+            mDC1 = mDC2 = mDGain = 0;
+            mJump = false;
+        }
+        else{
+            mDC1 = (c1 - mC1) * mInvPeriod;
+            mDC2 = (c2 - mC2) * mInvPeriod;
+            mDGain = (gain - mGain) * mInvPeriod;
+        }
+        mCount = mPeriod;
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef SYNTHTUTORIAL_DSP_CONVOLUTIONREVERB_HPP
+#define SYNTHTUTORIAL_DSP_CONVOLUTIONREVERB_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           ConvolutionReverb.hpp
+    Description:    Reverb by convolution with a recorded impulse response,
+                    for the whole mix.
+
+    Direct convolution with a 10 s impulse response costs half a million
+    multiply-adds per sample. Here the response is cut into partitions that
+    are convolved by FFT (uniformly partitioned overlap-save, with the
+    spectra of past input blocks kept in a frequency-domain delay line), so
+    each partition costs one complex multiply-add per bin per block.
+
+    Two partition sizes share the work:
+
+      - the head, the first 2 * tailBlock samples of the response, in
+        partitions of blockSize (256), runs on the audio thread and has no
+        latency when the audio block is a multiple of blockSize;
+      - the tail, the rest, in partitions of tailBlock (4096), runs on a
+        background thread. It starts 2 * tailBlock samples into the
+        response, so each tail block may take up to tailBlock samples of
+        time (85 ms at 48 kHz) to compute.
+
+    If the background thread misses its deadline the tail of that block is
+    dropped and counted in underruns().
+
+    The input is mixed to mono and convolved with each channel of the
+    response (a mono response gives the same output on both sides). Both
+    output channels come from one inverse FFT: the left response is put in
+    the real part of the partition spectra and the right in the imaginary
+    part.
+
+    load() must be called before audio starts.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FFT.hpp"
+#include "SampleStreamer.hpp"
+#include "../engine/Denormals.hpp"
+
+/// Uniformly partitioned convolution of a mono input with a stereo response
+class PartitionedConvolver {
+public:
+
+    /// Set the response; L and R have length samples (R may equal L)
+    void init(const float * L, const float * R, unsigned length, unsigned block){
+        mBlock = block;
+        mFFT.size(2*block);
+        const unsigned N = mFFT.size();
+        mParts = (length + block - 1) / block;
+        if(mParts == 0) mParts = 1;
+        mIR.assign(size_t(mParts) * N, FFT::Complex(0.f));
+        for(unsigned p=0; p<mParts; ++p){
+            FFT::Complex * h = &mIR[size_t(p) * N];
+            for(unsigned i=0; i<block && p*block + i < length; ++i){
+                h[i] = FFT::Complex(L[p*block + i], R[p*block + i]);
+            }
+            mFFT.forward(h);
+            // Fold the 1/N of the inverse transform into the response
+            for(unsigned k=0; k<N; ++k) h[k] *= 1.f / N;
+        }
+        mFDL.assign(size_t(mParts) * N, FFT::Complex(0.f));
+        mPrev.assign(block, 0.f);
+        mWork.resize(N);
+        mCurrent = 0;
+    }
+
+    unsigned block() const { return mBlock; }
+
+    /// Convolve block() input samples; writes block() samples to L and R
+    void process(const float * in, float * L, float * R){
+        const unsigned N = mFFT.size(), B = mBlock;
+        mCurrent = mCurrent == 0 ? mParts - 1 : mCurrent - 1;
+        FFT::Complex * x = &mFDL[size_t(mCurrent) * N];
+        for(unsigned i=0; i<B; ++i){
+            x[i] = FFT::Complex(mPrev[i], 0.f);
+            x[B + i] = FFT::Complex(in[i], 0.f);
+            mPrev[i] = in[i];
+        }
+        mFFT.forward(x);
+
+        // Sum input spectra, newest first, times the partitions in order
+        float * acc = reinterpret_cast<float *>(mWork.data());
+        std::fill(acc, acc + 2*N, 0.f);
+        for(unsigned p=0; p<mParts; ++p){
+            unsigned slot = mCurrent + p < mParts ? mCurrent + p : mCurrent + p - mParts;
+            const float * a = reinterpret_cast<const float *>(&mFDL[size_t(slot) * N]);
+            const float * h = reinterpret_cast<const float *>(&mIR[size_t(p) * N]);
+            for(unsigned k=0; k<2*N; k+=2){
+                acc[k]   += a[k]*h[k]   - a[k+1]*h[k+1];
+                acc[k+1] += a[k]*h[k+1] + a[k+1]*h[k];
+            }
+        }
+        mFFT.inverse(mWork.data());
+
+        // Overlap-save: the second half is the linear convolution
+        for(unsigned i=0; i<B; ++i){
+            L[i] = mWork[B + i].real();
+            R[i] = mWork[B + i].imag();
+        }
+    }
+
+private:
+    FFT mFFT;
+    unsigned mBlock = 0, mParts = 0, mCurrent = 0;
+    std::vector<FFT::Complex> mIR;      // partition spectra
+    std::vector<FFT::Complex> mFDL;     // input block spectra
+    std::vector<FFT::Complex> mWork;
+    std::vector<float> mPrev;
+};
+
+
+class ConvolutionReverb {
+public:
+
+    static const unsigned kSlots = 4;   // tail blocks in flight
+
+    /// @param[in] blockSize  head partition size, ideally the audio block
+    /// @param[in] tailBlock  tail partition size, a multiple of blockSize
+    ConvolutionReverb(unsigned blockSize=256, unsigned tailBlock=4096)
+    :   mBlock(blockSize), mTailBlock(tailBlock / blockSize * blockSize)
+    {
+        if(mTailBlock < mBlock) mTailBlock = mBlock;
+        std::vector<float> silence(1, 0.f);
+        mHead.init(silence.data(), silence.data(), 1, mBlock);
+        mIn.resize(mBlock);
+        mOutL.resize(mBlock);
+        mOutR.resize(mBlock);
+    }
+
+    ~ConvolutionReverb(){ stopTail(); }
+
+    /// Load a WAV impulse response (1 or 2 channels); false on failure
+    bool load(const std::string& path, double sampleRate=48000){
+        WavReader wav;
+        if(!wav.open(path)) return false;
+        const unsigned ch = wav.channels();
+        const unsigned n = unsigned(wav.frames());
+        std::vector<float> frames(size_t(n) * ch);
+        unsigned got = wav.read(0, frames.data(), n);
+        std::vector<float> L(got), R(got);
+        for(unsigned i=0; i<got; ++i){
+            L[i] = frames[size_t(i) * ch];
+            R[i] = frames[size_t(i) * ch + (ch > 1 ? 1 : 0)];
+        }
+        if(wav.sampleRate() != unsigned(sampleRate)){
+            std::printf("ConvolutionReverb: %s is at %u Hz, the audio at %g Hz\n",
+                        path.c_str(), wav.sampleRate(), sampleRate);
+        }
+        set(L.data(), R.data(), got);
+        return true;
+    }
+
+    /// Set the response directly
+    void set(const float * L, const float * R, unsigned length){
+        stopTail();
+        const unsigned headLength = std::min(length, 2*mTailBlock);
+        mHead.init(L, R, headLength, mBlock);
+        mHasTail = length > headLength;
+        if(mHasTail){
+            mTail.init(L + headLength, R + headLength, length - headLength, mTailBlock);
+            mTailIn.assign(size_t(kSlots) * mTailBlock, 0.f);
+            mTailOutL.assign(size_t(kSlots) * mTailBlock, 0.f);
+            mTailOutR.assign(size_t(kSlots) * mTailBlock, 0.f);
+        }
+        mTime = 0;
+        mSubmitted = 0;
+        mDone = 0;
+        mInFill = 0;
+        mQueueL.clear();
+        mQueueR.clear();
+        mQueueL.reserve(8 * mBlock);
+        mQueueR.reserve(8 * mBlock);
+        if(mHasTail){
+            mRunning = true;
+            mThread = std::thread([this]{ runTail(); });
+        }
+    }
+
+    /// Wet level
+    void mix(float v){ mMix.store(v, std::memory_order_relaxed); }
+    float mix() const { return mMix.load(std::memory_order_relaxed); }
+
+    /// Add the reverb of inL and inR into outL and outR; the inputs and
+    /// outputs may be the same buffers
+    void process(const float * inL, const float * inR, float * outL, float * outR, unsigned n){
+        unsigned written = 0, read = 0;
+        while(read < n){
+            unsigned k = std::min(n - read, mBlock - mInFill);
+            for(unsigned i=0; i<k; ++i) mIn[mInFill + i] = 0.5f * (inL[read + i] + inR[read + i]);
+            mInFill += k;
+            read += k;
+            if(mInFill == mBlock){
+                processBlock();
+                mInFill = 0;
+            }
+            // Emit what is ready while the input is still intact
+            written += drain(outL + written, outR + written, read - written);
+        }
+        // Blocks shorter than blockSize: start with silence until one is done
+        if(written < n){
+            unsigned gap = n - written;
+            mQueueL.insert(mQueueL.begin(), gap, 0.f);
+            mQueueR.insert(mQueueR.begin(), gap, 0.f);
+            drain(outL + written, outR + written, gap);
+        }
+    }
+
+    /// Tail blocks that were not ready in time
+    unsigned underruns() const { return mUnderruns.load(); }
+
+    /// Length of the response handled on the audio thread
+    unsigned headLength() const { return 2*mTailBlock; }
+
+private:
+    unsigned mBlock, mTailBlock;
+    PartitionedConvolver mHead, mTail;
+    bool mHasTail = false;
+    std::atomic<float> mMix {0.3f};
+
+    // Audio thread
+    std::vector<float> mIn, mOutL, mOutR;
+    unsigned mInFill = 0;
+    uint64_t mTime = 0;                 // head blocks processed, in samples
+    std::vector<float> mQueueL, mQueueR;
+
+    // Shared with the tail thread
+    std::vector<float> mTailIn, mTailOutL, mTailOutR;
+    std::atomic<uint64_t> mSubmitted {0}, mDone {0};
+    std::atomic<unsigned> mUnderruns {0};
+    std::atomic<bool> mRunning {false};
+    std::thread mThread;
+
+    void processBlock(){
+        mHead.process(mIn.data(), mOutL.data(), mOutR.data());
+        if(mHasTail){
+            const unsigned T = mTailBlock;
+            // Collect input for the tail
+            uint64_t block = mTime / T;
+            unsigned offset = unsigned(mTime % T);
+            float * slot = &mTailIn[(block % kSlots) * T];
+            std::copy(mIn.begin(), mIn.end(), slot + offset);
+            if(offset + mBlock == T) mSubmitted.store(block + 1, std::memory_order_release);
+
+            // Tail block k sounds from (k + 2) * T on
+            if(block >= 2){
+                uint64_t k = block - 2;
+                if(mDone.load(std::memory_order_acquire) > k){
+                    const float * l = &mTailOutL[(k % kSlots) * T + offset];
+                    const float * r = &mTailOutR[(k % kSlots) * T + offset];
+                    for(unsigned i=0; i<mBlock; ++i){ mOutL[i] += l[i]; mOutR[i] += r[i]; }
+                }
+                else if(offset == 0) mUnderruns.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        mTime += mBlock;
+        const float mix = mMix.load(std::memory_order_relaxed);
+        for(unsigned i=0; i<mBlock; ++i){
+            mQueueL.push_back(mOutL[i] * mix);
+            mQueueR.push_back(mOutR[i] * mix);
+        }
+    }
+
+    unsigned drain(float * L, float * R, unsigned n){
+        n = std::min<unsigned>(n, mQueueL.size());
+        for(unsigned i=0; i<n; ++i){ L[i] += mQueueL[i]; R[i] += mQueueR[i]; }
+        mQueueL.erase(mQueueL.begin(), mQueueL.begin() + n);
+        mQueueR.erase(mQueueR.begin(), mQueueR.begin() + n);
+        return n;
+    }
+
+    void runTail(){
+        disableDenormals();
+        const unsigned T = mTailBlock;
+        while(mRunning){
+            uint64_t k = mDone.load(std::memory_order_relaxed);
+            if(k < mSubmitted.load(std::memory_order_acquire)){
+                mTail.process(&mTailIn[(k % kSlots) * T],
+                              &mTailOutL[(k % kSlots) * T], &mTailOutR[(k % kSlots) * T]);
+                mDone.store(k + 1, std::memory_order_release);
+            }
+            else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void stopTail(){
+        mRunning = false;
+        if(mThread.joinable()) mThread.join();
+    }
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef SYNTHTUTORIAL_DSP_DELAYARENA_HPP
+#define SYNTHTUTORIAL_DSP_DELAYARENA_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           DelayArena.hpp
+    Description:    Preallocated delay-line memory that voices lease.
+
+    gam::Delay owns its buffer and allocates it whenever maxDelay() changes
+    the size. A DelayArena allocates every line up front with reserve(),
+    grouped in power-of-two sizes. Voices lease a line when they are
+    triggered and return it when they are freed, so delay memory is never
+    allocated or resized on the audio thread. lease() and release() are
+    lock-free and may be called from any thread.
+
+    ArenaDelay is a delay line over a leased ring. Since the ring size is a
+    power of two, indices wrap with a bitmask.
+*/
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+/// A ring of delay memory leased from a DelayArena
+struct DelayLease {
+    float * buf = nullptr;
+    unsigned mask = 0;      ///< ring size - 1
+    int pool = -1;
+    int line = -1;
+
+    bool valid() const { return buf != nullptr; }
+    unsigned size() const { return mask + 1; }
+};
+
+class DelayArena {
+public:
+
+    /// Preallocate lines
+
+    /// @param[in] samples  minimum line length; rounded up to a power of two
+    /// @param[in] count    number of lines of that length
+    ///
+    /// Call this before audio starts; it is the only method that allocates.
+    void reserve(unsigned samples, unsigned count){
+        unsigned size = 1;
+        while(size < samples) size <<= 1;
+        for(auto& p : mPools){
+            if(p->size == size){ p->grow(count); return; }
+        }
+        // Keep pools sorted by size so lease() finds the tightest fit
+        std::unique_ptr<Pool> p(new Pool(size));
+        p->grow(count);
+        auto it = mPools.begin();
+        while(it != mPools.end() && (*it)->size < size) ++it;
+        mPools.insert(it, std::move(p));
+    }
+
+    /// Lease a line of at least the given number of samples
+
+    /// The line is zeroed. Returns an invalid lease if no line is free.
+    ///
+    DelayLease lease(unsigned samples){
+        DelayLease l;
+        for(unsigned p=0; p<mPools.size(); ++p){
+            Pool& pool = *mPools[p];
+            if(pool.size < samples) continue;
+            for(unsigned i=0; i<pool.count; ++i){
+                bool expect = false;
+                if(pool.used[i].compare_exchange_strong(expect, true)){
+                    l.buf = &pool.mem[size_t(i) * pool.size];
+                    l.mask = pool.size - 1;
+                    l.pool = int(p);
+                    l.line = int(i);
+                    for(unsigned k=0; k<pool.size; ++k) l.buf[k] = 0.f;
+                    return l;
+                }
+            }
+        }
+        return l;
+    }
+
+    /// Return a line to the arena and invalidate the lease
+    void release(DelayLease& l){
+        if(l.valid()){
+            mPools[l.pool]->used[l.line].store(false, std::memory_order_release);
+        }
+        l = DelayLease();
+    }
+
+    /// Number of lines currently leased
+    unsigned numLeased() const {
+        unsigned n = 0;
+        for(auto& p : mPools){
+            for(unsigned i=0; i<p->count; ++i) n += p->used[i].load();
+        }
+        return n;
+    }
+
+private:
+    struct Pool {
+        unsigned size;
+        unsigned count = 0;
+        std::vector<float> mem;
+        std::unique_ptr<std::atomic<bool>[]> used;
+
+        Pool(unsigned sz): size(sz) {}
+
+        void grow(unsigned n){
+            // Only valid while nothing is leased, i.e. before audio starts
+            count += n;
+            mem.assign(size_t(size) * count, 0.f);
+            used.reset(new std::atomic<bool>[count]);
+            for(unsigned i=0; i<count; ++i) used[i] = false;
+        }
+    };
+
+    std::vector<std::unique_ptr<Pool>> mPools;
+};
+
+
+/// Delay line in arena memory
+class ArenaDelay {
+public:
+
+    /// Lease a ring that can hold the given delay in samples
+    bool lease(DelayArena& arena, unsigned maxDelay){
+        if(!mLease.valid()){
+            mArena = &arena;
+            mLease = arena.lease(maxDelay + 1);
+            mPos = 0;
+        }
+        return mLease.valid();
+    }
+
+    /// Give the ring back to its arena
+    void release(){
+        if(mArena) mArena->release(mLease);
+        mArena = nullptr;
+    }
+
+    bool valid() const { return mLease.valid(); }
+
+    /// Set delay in samples; clipped to the leased ring
+
+    /// readCubic() needs one sample on either side of the two it
+    /// interpolates, so it further clamps the delay to 2 .. size()-2.
+    ///
+    void delay(float samples){
+        float maxDelay = float(mLease.mask);
+        mDelay = samples < 1.f ? 1.f : (samples > maxDelay ? maxDelay : samples);
+    }
+    float delay() const { return mDelay; }
+
+    /// Zero the ring; does nothing without a lease
+    void zero(){
+        if(!valid()) return;
+        for(unsigned i=0; i<mLease.size(); ++i) mLease.buf[i] = 0.f;
+    }
+
+    /// Read the sample at the current delay, truncating the fraction
+    float read() const {
+        return mLease.buf[(mPos - unsigned(mDelay)) & mLease.mask];
+    }
+
+    /// Read the sample at the current delay with linear interpolation
+    float readLinear() const {
+        unsigned d = unsigned(mDelay);
+        float frac = mDelay - float(d);
+        float a = mLease.buf[(mPos - d) & mLease.mask];
+        float b = mLease.buf[(mPos - d - 1) & mLease.mask];
+        return a + (b - a) * frac;
+    }
+
+    /// Read the sample at the current delay with cubic interpolation
+    float readCubic() const {
+        // Below 2 the newest tap would be the slot about to be written,
+        // which holds the oldest sample; above size()-2 the oldest tap
+        // wraps around to the newest
+        const unsigned m = mLease.mask;
+        const float hi = float(m) - 1.f;
+        const float delay = mDelay < 2.f ? 2.f : (mDelay > hi ? hi : mDelay);
+        unsigned d = unsigned(delay);
+        float f = delay - float(d);
+        float w = mLease.buf[(mPos - d + 1) & m];
+        float x = mLease.buf[(mPos - d) & m];
+        float y = mLease.buf[(mPos - d - 1) & m];
+        float z = mLease.buf[(mPos - d - 2) & m];
+        // Catmull-Rom spline through w, x, y, z evaluated between x and y
+        float c1 = 0.5f * (y - w);
+        float c2 = w - 2.5f * x + 2.f * y - 0.5f * z;
+        float c3 = 0.5f * (z - w) + 1.5f * (x - y);
+        return ((c3 * f + c2) * f + c1) * f + x;
+    }
+
+    /// Write the next input sample
+    void write(float v){
+        mLease.buf[mPos & mLease.mask] = v;
+        ++mPos;
+    }
+
+    /// Read the delayed sample, then write the input (like gam::Delay)
+    float operator()(float in){
+        float o = read();
+        write(in);
+        return o;
+    }
+
+    /// Read the delayed sample without writing (like gam::Delay)
+    float operator()() const { return read(); }
+
+private:
+    DelayLease mLease;
+    DelayArena * mArena = nullptr;
+    unsigned mPos = 0;
+    float mDelay = 1.f;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef SYNTHTUTORIAL_DSP_FFT_HPP
+#define SYNTHTUTORIAL_DSP_FFT_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           FFT.hpp
+    Description:    In-place complex FFT of a power-of-two size.
+
+    Iterative radix-2 transform with the bit-reversal permutation and the
+    twiddle factors computed once in the constructor, so transforms do not
+    allocate and can run on the audio thread. Neither direction is scaled:
+    inverse(forward(x)) is size() * x.
+
+    Two real signals can share one transform: put one in the real and the
+    other in the imaginary part.
+*/
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+class FFT {
+public:
+
+    typedef std::complex<float> Complex;
+
+    /// @param[in] n  size, a power of two
+    explicit FFT(unsigned n=1024){ size(n); }
+
+    void size(unsigned n){
+        mBits = 0;
+        while((1u << mBits) < n) ++mBits;
+        mN = 1u << mBits;
+        mTwiddle.resize(mN/2);
+        for(unsigned k=0; k<mN/2; ++k){
+            double a = -2 * M_PI * k / mN;
+            mTwiddle[k] = Complex(float(std::cos(a)), float(std::sin(a)));
+        }
+        mReverse.resize(mN);
+        for(unsigned i=0; i<mN; ++i){
+            unsigned r = 0;
+            for(unsigned b=0; b<mBits; ++b) r |= ((i >> b) & 1) << (mBits - 1 - b);
+            mReverse[i] = r;
+        }
+    }
+    unsigned size() const { return mN; }
+
+    /// Forward transform, e^(-i 2 pi k n / N)
+    void forward(Complex * x) const { transform(x, false); }
+
+    /// Inverse transform, e^(+i 2 pi k n / N), without the 1/N
+    void inverse(Complex * x) const { transform(x, true); }
+
+private:
+    unsigned mN = 0, mBits = 0;
+    std::vector<Complex> mTwiddle;
+    std::vector<unsigned> mReverse;
+
+    void transform(Complex * x, bool inv) const {
+        for(unsigned i=0; i<mN; ++i){
+            unsigned r = mReverse[i];
+            if(r > i) std::swap(x[i], x[r]);
+        }
+        // Plain float arithmetic avoids the inf/nan handling of complex *
+        float * v = reinterpret_cast<float *>(x);
+        const float * tw = reinterpret_cast<const float *>(mTwiddle.data());
+        const float s = inv ? -1.f : 1.f;
+        for(unsigned len=2; len<=mN; len<<=1){
+            const unsigned half = len/2, step = mN/len;
+            for(unsigned i=0; i<mN; i+=len){
+                for(unsigned j=0; j<half; ++j){
+                    const float wr = tw[2*j*step], wi = s * tw[2*j*step + 1];
+                    float * a = v + 2*(i+j);
+                    float * b = v + 2*(i+j+half);
+                    const float br = b[0]*wr - b[1]*wi;
+                    const float bi = b[0]*wi + b[1]*wr;
+                    b[0] = a[0] - br;
+                    b[1] = a[1] - bi;
+                    a[0] += br;
+                    a[1] += bi;
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef SYNTHTUTORIAL_DSP_FDNREVERB_HPP
+#define SYNTHTUTORIAL_DSP_FDNREVERB_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           FdnReverb.hpp
+    Description:    Feedback delay network reverb for a whole mix.
+
+    N delay lines (8 or 16) feed back into each other through an orthogonal
+    matrix, so the echoes multiply and the energy is only lost through the
+    decay gains. Each line is damped by a one-pole lowpass, so high
+    frequencies die out first. This costs a few operations per line per
+    sample, much less than ConvolutionReverb, and needs no impulse response.
+
+    The matrix is either
+
+      - Householder, I - 2/N * ones: one sum over the lines and one subtract
+        per line, or
+      - Hadamard: log2(N) stages of butterflies, scaled by 1/sqrt(N), which
+        spreads energy more evenly between lines.
+
+    The network runs in blocks of at most kBlock samples, shorter than every
+    delay, so a block never reads what it writes. Each step is then a loop
+    over a whole block or across the lines with no branches, which the
+    compiler vectorizes. Every ring has kBlock + 1 guard samples mirroring
+    its start, so the interpolated read of a block is one contiguous span.
+
+    Line lengths are spread geometrically between 30 and 90 ms times size()
+    and rounded to primes. Modulation slowly sways each line's delay by a
+    few samples to break up metallic ringing; it is computed once per block
+    rather than per sample, together with the decay gains.
+
+    init() allocates and must be called before audio starts.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+template <unsigned N=8>
+class FdnReverb {
+public:
+
+    static_assert(N >= 4 && (N & (N-1)) == 0, "FdnReverb: N must be a power of two");
+
+    static const unsigned kBlock = 64;  ///< samples per control period
+
+    enum Matrix { HOUSEHOLDER, HADAMARD };
+
+    /// Allocate the delay lines
+
+    /// @param[in] sampleRate   audio sample rate
+    /// @param[in] maxSize      largest size() that will be used
+    void init(double sampleRate, float maxSize=2.f){
+        mSampleRate = float(sampleRate);
+        mMaxSize = maxSize;
+        const float minMs = 30.f, maxMs = 90.f;
+        unsigned longest = 0;
+        for(unsigned i=0; i<N; ++i){
+            float ms = minMs * std::pow(maxMs / minMs, float(i) / (N-1));
+            mBase[i] = float(nextPrime(unsigned(ms * 0.001f * mSampleRate)));
+            longest = std::max(longest, unsigned(mBase[i] * maxSize));
+        }
+        unsigned ring = 1;
+        while(ring < longest + kModMax + kBlock + 4) ring <<= 1;
+        mMask = ring - 1;
+        mRing.assign(size_t(N) * stride(), 0.f);
+        for(unsigned i=0; i<N; ++i){
+            mPhase[i] = float(i) / N;
+            mLowpass[i] = 0.f;
+        }
+        mPos = 0;
+        mSizeNow = mSize;
+    }
+
+    /// Clear the delay lines
+    void reset(){
+        std::fill(mRing.begin(), mRing.end(), 0.f);
+        for(unsigned i=0; i<N; ++i) mLowpass[i] = 0.f;
+    }
+
+    /// Wet level
+    void mix(float v){ mMix = v; }
+    float mix() const { return mMix; }
+
+    /// Time in seconds to decay by 60 dB
+    void decay(float t60){ mDecay = std::max(t60, 0.01f); }
+    float decay() const { return mDecay; }
+
+    /// Lowpass cutoff in the feedback path in Hz
+    void damping(float hz){ mDamping = hz; }
+    float damping() const { return mDamping; }
+
+    /// Scale of the line lengths, 0.25 to init()'s maxSize; glides
+    void size(float v){ mSize = std::min(std::max(v, 0.25f), mMaxSize); }
+    float size() const { return mSize; }
+
+    /// Delay modulation depth in samples (at most 16) and rate in Hz
+    void modulation(float depth, float rate){
+        mModDepth = std::min(std::max(depth, 0.f), float(kModMax));
+        mModRate = rate;
+    }
+
+    void matrix(Matrix m){ mMatrix = m; }
+    Matrix matrix() const { return mMatrix; }
+
+    /// Add the reverb of inL and inR into outL and outR; the inputs and
+    /// outputs may be the same buffers
+    void process(const float * inL, const float * inR, float * outL, float * outR, unsigned n){
+        if(mRing.empty()) return;
+        while(n > 0){
+            unsigned k = std::min(n, kBlock);
+            processBlock(inL, inR, outL, outR, k);
+            inL += k; inR += k; outL += k; outR += k;
+            n -= k;
+        }
+    }
+
+private:
+    static const unsigned kModMax = 16;
+
+    float mSampleRate = 48000, mMaxSize = 2;
+    float mMix = 0.3f, mDecay = 2.5f, mDamping = 6000, mSize = 1, mSizeNow = 1;
+    float mModDepth = 4, mModRate = 0.5f;
+    Matrix mMatrix = HADAMARD;
+
+    float mBase[N];             // line lengths at size 1
+    float mPhase[N];            // modulation phases, in cycles
+    float mLowpass[N];
+    std::vector<float> mRing;   // N rings of mMask + 1 samples plus guard
+    unsigned mMask = 0, mPos = 0;
+
+    // Per block
+    float mX[N][kBlock];        // line outputs, then line inputs
+    float mIn[kBlock];
+
+    unsigned stride() const { return mMask + 1 + kBlock + 1; }
+
+    static unsigned nextPrime(unsigned v){
+        for(;; ++v){
+            bool prime = v > 1;
+            for(unsigned d=2; d*d<=v && prime; ++d) prime = v % d != 0;
+            if(prime) return v;
+        }
+    }
+
+    void processBlock(const float * inL, const float * inR, float * outL, float * outR, unsigned n){
+        const float pi2 = 6.2831853f;
+
+        // Control rate: glide the size, move the modulation, set the gains
+        mSizeNow += (mSize - mSizeNow) * 0.02f;
+        const float lowpass = 1.f - std::exp(-pi2 * mDamping / mSampleRate);
+        float gain[N], delay[N];
+        for(unsigned i=0; i<N; ++i){
+            mPhase[i] += mModRate * (1.f + 0.1f * i / N) * n / mSampleRate;
+            mPhase[i] -= std::floor(mPhase[i]);
+            float length = mBase[i] * mSizeNow;
+            delay[i] = std::max(length + mModDepth * std::sin(pi2 * mPhase[i]), float(kBlock));
+            gain[i] = std::pow(10.f, -3.f * length / (mDecay * mSampleRate));
+        }
+
+        for(unsigned s=0; s<n; ++s) mIn[s] = 0.5f * (inL[s] + inR[s]);
+
+        // Read the line outputs: sample s of the block is read at delay[i]
+        // behind the position it will be written to
+        for(unsigned i=0; i<N; ++i){
+            unsigned d = unsigned(delay[i]);
+            float frac = delay[i] - d;
+            const float * src = &mRing[size_t(i) * stride() + ((mPos - d - 1) & mMask)];
+            float * x = mX[i];
+            for(unsigned s=0; s<n; ++s) x[s] = src[s+1] + (src[s] - src[s+1]) * frac;
+        }
+
+        // Output taps: all lines to the left, alternate signs to the right
+        const float tap = 1.f / std::sqrt(float(N));
+        for(unsigned s=0; s<n; ++s){
+            float l = 0.f, r = 0.f;
+            for(unsigned i=0; i<N; ++i){
+                l += mX[i][s];
+                r += (i & 1) ? -mX[i][s] : mX[i][s];
+            }
+            outL[s] += l * tap * mMix;
+            outR[s] += r * tap * mMix;
+        }
+
+        // Mix the lines
+        if(mMatrix == HOUSEHOLDER){
+            float sum[kBlock];
+            for(unsigned s=0; s<n; ++s) sum[s] = 0.f;
+            for(unsigned i=0; i<N; ++i){
+                for(unsigned s=0; s<n; ++s) sum[s] += mX[i][s];
+            }
+            for(unsigned i=0; i<N; ++i){
+                for(unsigned s=0; s<n; ++s) mX[i][s] -= sum[s] * (2.f / N);
+            }
+        }
+        else {
+            for(unsigned h=1; h<N; h<<=1){
+                for(unsigned i=0; i<N; i+=2*h){
+                    for(unsigned j=i; j<i+h; ++j){
+                        float * a = mX[j];
+                        float * b = mX[j+h];
+                        for(unsigned s=0; s<n; ++s){
+                            float u = a[s], v = b[s];
+                            a[s] = u + v;
+                            b[s] = u - v;
+                        }
+                    }
+                }
+            }
+            for(unsigned i=0; i<N; ++i){
+                for(unsigned s=0; s<n; ++s) mX[i][s] *= tap;
+            }
+        }
+
+        // Damp, decay and add half the input, with a sign pattern per line
+        for(unsigned s=0; s<n; ++s){
+            for(unsigned i=0; i<N; ++i){
+                mLowpass[i] += (mX[i][s] - mLowpass[i]) * lowpass;
+                float sign = (i & 2) ? -0.5f : 0.5f;
+                mX[i][s] = mLowpass[i] * gain[i] + mIn[s] * sign;
+            }
+        }
+
+        // Write the line inputs, mirroring the start of each ring in its guard
+        for(unsigned i=0; i<N; ++i){
+            float * ring = &mRing[size_t(i) * stride()];
+            for(unsigned s=0; s<n; ++s){
+                unsigned p = (mPos + s) & mMask;
+                ring[p] = mX[i][s];
+                if(p <= kBlock) ring[p + mMask + 1] = mX[i][s];
+            }
+        }
+        mPos += n;
+    }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SYNTHTUTORIAL_DSP_FUSED_HPP
+#define SYNTHTUTORIAL_DSP_FUSED_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           Fused.hpp
+    Description:    Compose unit generators into one fused block loop.
+
+    A voice's inner loop usually ticks several unit generators and combines
+    their outputs with a little arithmetic, one sample at a time. Here the
+    same graph is written as an expression,
+
+        auto osc = fused::gen(mOsc);
+        auto am  = fused::gen(mAM);
+        auto amt = fused::gen(mAMEnv);
+        auto env = fused::gen(mAmpEnv);
+        auto out = fused::stream((osc*(1.f-amt) + osc*am*amt) * env * amp, n);
+
+    and evaluated a chunk at a time. Each generator (anything with a
+    float operator()(), i.e. any Gamma generator) is ticked exactly once
+    per sample into a small buffer, even when it appears several times in
+    the expression. The arithmetic then runs as one loop over the chunk
+    with the expression inlined at compile time, which the compiler can
+    vectorize. out() hands the result back one sample at a time, so the
+    rest of the voice (peak, panning, io.out) stays as it was.
+
+    n is the number of samples the voice will take, which in a SynthVoice
+    is io.framesPerBuffer() - io.frame(): a note can start mid-block, and
+    generators ticked for samples that are never taken would run ahead.
+
+    The expression only holds references to the generators and to the
+    gen() leaves, so name each leaf as above, build the expression in
+    onProcess() and let it go out of scope at the end of the block.
+*/
+
+namespace fused {
+
+/// Samples evaluated per pass
+static const unsigned kChunk = 64;
+
+/// Unique number for each evaluation pass on this thread
+inline unsigned nextPass(){
+    static thread_local unsigned pass = 0;
+    return ++pass;
+}
+
+/// Base of all expression nodes
+template <class E>
+struct Expr {
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+
+/// Leaf wrapping a generator
+template <class U>
+class Gen : public Expr<Gen<U>> {
+public:
+    explicit Gen(U& u): mU(u) {}
+
+    /// Tick the generator for the next n samples, once per pass
+    void fill(unsigned n, unsigned pass) const {
+        if(pass == mPass) return;
+        mPass = pass;
+        for(unsigned i=0; i<n; ++i) mBuf[i] = mU();
+    }
+
+    float operator[](unsigned i) const { return mBuf[i]; }
+
+private:
+    U& mU;
+    mutable float mBuf[kChunk];
+    mutable unsigned mPass = 0;
+};
+
+/// Leaf holding a constant
+struct Scalar : public Expr<Scalar> {
+    explicit Scalar(float v): value(v) {}
+    void fill(unsigned, unsigned) const {}
+    float operator[](unsigned) const { return value; }
+    float value;
+};
+
+
+// Generators are referenced so that their buffer is shared by every use;
+// all other nodes are small and held by value.
+template <class T> struct Stored { typedef const T type; };
+template <class U> struct Stored<Gen<U>> { typedef const Gen<U>& type; };
+
+struct Add { static float apply(float a, float b){ return a + b; } };
+struct Sub { static float apply(float a, float b){ return a - b; } };
+struct Mul { static float apply(float a, float b){ return a * b; } };
+
+/// Node combining two expressions sample by sample
+template <class Op, class A, class B>
+class Binary : public Expr<Binary<Op,A,B>> {
+public:
+    Binary(const A& a, const B& b): mA(a), mB(b) {}
+
+    void fill(unsigned n, unsigned pass) const {
+        mA.fill(n, pass);
+        mB.fill(n, pass);
+    }
+
+    float operator[](unsigned i) const { return Op::apply(mA[i], mB[i]); }
+
+private:
+    typename Stored<A>::type mA;
+    typename Stored<B>::type mB;
+};
+
+#define FUSED_OPERATOR(op, Op)\
+template <class A, class B>\
+Binary<Op,A,B> operator op(const Expr<A>& a, const Expr<B>& b){\
+    return Binary<Op,A,B>(a.self(), b.self());\
+}\
+template <class A>\
+Binary<Op,A,Scalar> operator op(const Expr<A>& a, float b){\
+    return Binary<Op,A,Scalar>(a.self(), Scalar(b));\
+}\
+template <class B>\
+Binary<Op,Scalar,B> operator op(float a, const Expr<B>& b){\
+    return Binary<Op,Scalar,B>(Scalar(a), b.self());\
+}
+
+FUSED_OPERATOR(+, Add)
+FUSED_OPERATOR(-, Sub)
+FUSED_OPERATOR(*, Mul)
+
+#undef FUSED_OPERATOR
+
+
+/// Reads an expression one sample at a time, evaluating it by chunks
+template <class E>
+class Stream {
+public:
+
+    /// @param[in] e    expression to evaluate
+    /// @param[in] n    number of samples that will be read, e.g. one block
+    Stream(const E& e, unsigned n): mE(e), mLeft(n) {}
+
+    /// Next output sample
+    float operator()(){
+        if(mPos == mLen){
+            if(0 == mLeft) return 0.f;
+            evaluate();
+        }
+        return mBuf[mPos++];
+    }
+
+private:
+    typename Stored<E>::type mE;
+    float mBuf[kChunk];
+    unsigned mLeft;
+    unsigned mPos = 0, mLen = 0;
+
+    void evaluate(){
+        // Never tick generators past the requested number of samples
+        mLen = mLeft < kChunk ? mLeft : kChunk;
+        mLeft -= mLen;
+        mE.fill(mLen, nextPass());
+        for(unsigned i=0; i<mLen; ++i) mBuf[i] = mE[i];
+        mPos = 0;
+    }
+};
+
+
+/// Wrap a generator for use in an expression
+template <class U>
+Gen<U> gen(U& u){ return Gen<U>(u); }
+
+/// Read n samples of an expression
+template <class E>
+Stream<E> stream(const Expr<E>& e, unsigned n){ return Stream<E>(e.self(), n); }
+
+/// Evaluate n samples of an expression into a buffer
+template <class E>
+void render(const Expr<E>& e, float * out, unsigned n){
+    for(unsigned i=0; i<n; i+=kChunk){
+        unsigned len = n-i < kChunk ? n-i : kChunk;
+        e.self().fill(len, nextPass());
+        for(unsigned k=0; k<len; ++k) out[i+k] = e.self()[k];
+    }
+}
+
+} // fused::
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef SYNTHTUTORIAL_DSP_MORPHTABLE_HPP
+#define SYNTHTUTORIAL_DSP_MORPHTABLE_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           MorphTable.hpp
+    Description:    Wavetable oscillator that morphs through a stack of
+                    frames.
+
+    The "table" parameter picks one table per note, so the timbre cannot
+    change while the note plays. WaveFrames holds several single-cycle
+    tables (frames) of the same power-of-two size in one contiguous block.
+    MorphOsc reads two adjacent frames at the same phase and crossfades
+    between them by a continuous position: 0 is the first frame, 1 the
+    second, 1.5 halfway between the second and the third, and so on. The
+    position can glide during the note, which gives an evolving timbre for
+    two table reads per sample.
+
+    Each frame is stored with one guard sample, a copy of its first
+    sample, so linear interpolation never has to wrap the index.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Gamma/Domain.h"
+
+/// Contiguous stack of single-cycle frames
+class WaveFrames {
+public:
+
+    /// Set number of frames and samples per frame (a power of two)
+    void resize(unsigned numFrames, unsigned frameSize){
+        mBits = 0;
+        while((1u << mBits) < frameSize) ++mBits;
+        mSize = 1u << mBits;
+        mNumFrames = numFrames;
+        mData.assign(size_t(mNumFrames) * stride(), 0.f);
+    }
+
+    /// Copy a frame of frameSize() samples
+    void set(unsigned i, const float * src){
+        float * f = frame(i);
+        for(unsigned k=0; k<mSize; ++k) f[k] = src[k];
+        f[mSize] = f[0];
+    }
+
+    /// Copy a frame from a Gamma array of the same size
+    template <class Array>
+    void set(unsigned i, const Array& src){ set(i, &src[0]); }
+
+    float * frame(unsigned i){ return &mData[size_t(i) * stride()]; }
+    const float * frame(unsigned i) const { return &mData[size_t(i) * stride()]; }
+
+    unsigned numFrames() const { return mNumFrames; }
+    unsigned frameSize() const { return mSize; }
+    unsigned frameBits() const { return mBits; }
+    unsigned stride() const { return mSize + 1; }
+
+private:
+    std::vector<float> mData;
+    unsigned mNumFrames = 0, mSize = 0, mBits = 0;
+};
+
+
+/// Oscillator crossfading between adjacent frames of a WaveFrames
+class MorphOsc : public gam::DomainObserver {
+public:
+
+    /// Set frames to read; they must outlive the oscillator
+    void source(const WaveFrames& f){ mFrames = &f; }
+
+    /// Set frequency
+    void freq(float v){
+        mFreq = v;
+        mInc = uint32_t(int64_t(double(v) * ups() * 4294967296.));
+    }
+    float freq() const { return mFreq; }
+
+    /// Set phase in [0, 1)
+    void phase(float v){ mPhase = uint32_t(int64_t(double(v) * 4294967296.)); }
+
+    /// Jump to a frame position in [0, numFrames-1]
+    void position(float p){ mPos = clip(p); mGlideLeft = 0; }
+    float position() const { return mPos; }
+
+    /// Glide linearly to a frame position over a time in seconds
+    void glide(float p, float seconds){
+        unsigned n = unsigned(seconds * spu());
+        if(n == 0){ position(p); return; }
+        mGlideEnd = clip(p);
+        mGlideInc = (mGlideEnd - mPos) / n;
+        mGlideLeft = n;
+    }
+
+    /// Generate next sample
+    float operator()(){
+        const WaveFrames& w = *mFrames;
+        const unsigned shift = 32 - w.frameBits();
+        const uint32_t i = mPhase >> shift;
+        const float f = float(mPhase & ((1u << shift) - 1)) * (1.f / float(1u << shift));
+
+        unsigned a = unsigned(mPos);
+        if(a + 1 >= w.numFrames()) a = w.numFrames() > 1 ? w.numFrames() - 2 : 0;
+        const float m = w.numFrames() > 1 ? mPos - float(a) : 0.f;
+        const float * fa = w.frame(a) + i;
+        const float * fb = w.numFrames() > 1 ? fa + w.stride() : fa;
+
+        float va = fa[0] + (fa[1] - fa[0]) * f;
+        float vb = fb[0] + (fb[1] - fb[0]) * f;
+
+        mPhase += mInc;
+        if(mGlideLeft){ mPos = --mGlideLeft ? mPos + mGlideInc : mGlideEnd; }
+        return va + (vb - va) * m;
+    }
+
+    void onDomainChange(double){ freq(mFreq); }
+
+private:
+    const WaveFrames * mFrames = nullptr;
+    float mFreq = 440;
+    uint32_t mPhase = 0, mInc = 0;
+    float mPos = 0, mGlideInc = 0, mGlideEnd = 0;
+    unsigned mGlideLeft = 0;
+
+    float clip(float p) const {
+        float last = mFrames && mFrames->numFrames() ? float(mFrames->numFrames() - 1) : 0.f;
+        return p < 0.f ? 0.f : (p > last ? last : p);
+    }
+};
+
+#endif
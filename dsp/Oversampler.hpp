@@ -0,0 +1,135 @@
+#ifndef SYNTHTUTORIAL_DSP_OVERSAMPLER_HPP
+#define SYNTHTUTORIAL_DSP_OVERSAMPLER_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           Oversampler.hpp
+    Description:    Run a voice at 2x or 4x the sample rate and decimate.
+
+    FM with a high index and AM with square or pulse tables produce
+    partials far above Nyquist, which fold back as inharmonic aliases. A
+    voice can instead render its mono signal at 2x or 4x the rate into the
+    buffer from begin() and get the decimated block back from end():
+
+        float * buf = mOversampler.begin(n);
+        for(unsigned i=0; i<n*mOversampler.factor(); ++i) buf[i] = ...;
+        const float * out = mOversampler.end(n);
+
+    In a SynthVoice, n is the number of frames left in the block,
+    io.framesPerBuffer() - io.frame(), since a note can start mid-block.
+
+    The unit generators that run at the higher rate are attached to
+    oversampledDomain(factor), so their frequencies and times are still
+    given in Hz and seconds.
+
+    Decimation is done by 2 per stage with a 47-tap halfband FIR (about
+    -85 dB from 0.8 of the output Nyquist frequency). Every other tap of a
+    halfband filter is zero and the rest are symmetric, so one output sample
+    costs 12 multiply-adds plus the center tap.
+*/
+
+#include <cmath>
+#include <vector>
+
+#include "Gamma/Domain.h"
+
+/// Halfband lowpass that halves the sample rate
+class HalfbandDecimator {
+public:
+
+    static const unsigned kPairs = 12;                  ///< nonzero coefficient pairs
+    static const unsigned kHistory = 4*kPairs - 2;      ///< taps - 1
+
+    HalfbandDecimator(){
+        // Blackman-windowed sinc at a quarter of the input rate
+        const double M = 2*kPairs;
+        double sum = 0;
+        for(unsigned k=0; k<kPairs; ++k){
+            double m = 2*k + 1;
+            double w = 0.42 + 0.5*std::cos(M_PI*m/M) + 0.08*std::cos(2*M_PI*m/M);
+            mCoef[k] = float(std::sin(M_PI*m/2) / (M_PI*m) * w);
+            sum += 2*mCoef[k];
+        }
+        // Unity gain at DC
+        for(auto& c : mCoef) c = float(c * 0.5 / sum);
+        mBuf.assign(kHistory + 2048, 0.f);
+    }
+
+    void reset(){
+        for(unsigned i=0; i<kHistory; ++i) mBuf[i] = 0.f;
+    }
+
+    /// Filter 2n input samples down to n; in and out may be the same buffer
+    void process(const float * in, float * out, unsigned n){
+        if(mBuf.size() < kHistory + 2*n) mBuf.resize(kHistory + 2*n);
+        float * x = mBuf.data();
+        for(unsigned i=0; i<2*n; ++i) x[kHistory + i] = in[i];
+        for(unsigned j=0; j<n; ++j){
+            // Latest tap is the newest input available for this output
+            const float * c = x + 2*j + 2*kPairs;
+            float y = 0.5f * c[0];
+            for(unsigned k=0; k<kPairs; ++k){
+                y += mCoef[k] * (c[-int(2*k+1)] + c[2*k+1]);
+            }
+            out[j] = y;
+        }
+        for(unsigned i=0; i<kHistory; ++i) x[i] = x[2*n + i];
+    }
+
+private:
+    float mCoef[kPairs];
+    std::vector<float> mBuf;    // history followed by the current input
+};
+
+
+/// Renders at 1x, 2x or 4x and decimates to the base rate
+class Oversampler {
+public:
+
+    /// Buffers grow on the audio thread only for blocks over 1024 samples
+    Oversampler(){ mBuf.resize(4 * 1024); }
+
+    /// Set oversampling factor: 1, 2 or 4; resets the filters
+    void factor(unsigned f){
+        mFactor = f >= 4 ? 4 : (f >= 2 ? 2 : 1);
+        mStage[0].reset();
+        mStage[1].reset();
+    }
+    unsigned factor() const { return mFactor; }
+
+    /// Buffer to write n * factor() oversampled samples into
+    float * begin(unsigned n){
+        if(mBuf.size() < n * mFactor) mBuf.resize(n * mFactor);
+        return mBuf.data();
+    }
+
+    /// Decimate the buffer, returns n samples at the base rate
+    const float * end(unsigned n){
+        float * b = mBuf.data();
+        if(mFactor == 4){
+            mStage[1].process(b, b, 2*n);
+        }
+        if(mFactor >= 2){
+            mStage[0].process(b, b, n);
+        }
+        return b;
+    }
+
+private:
+    unsigned mFactor = 1;
+    HalfbandDecimator mStage[2];
+    std::vector<float> mBuf;
+};
+
+
+/// Domain running at factor times the master sample rate
+inline gam::Domain& oversampledDomain(unsigned factor){
+    static gam::Domain d2, d4;
+    if(factor < 2) return gam::Domain::master();
+    gam::Domain& d = factor < 4 ? d2 : d4;
+    double spu = gam::Domain::master().spu() * (factor < 4 ? 2 : 4);
+    if(d.spu() != spu) d.spu(spu);
+    return d;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef SYNTHTUTORIAL_DSP_PARTIALTRACKS_HPP
+#define SYNTHTUTORIAL_DSP_PARTIALTRACKS_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           PartialTracks.hpp
+    Description:    Partial tracks from tools/partial_analyzer, for
+                    resynthesis.
+
+    Each track is one sinusoid found in the analyzed sound: the frame it
+    starts at, its frequency as a ratio to the sound's fundamental f0(), and
+    its amplitude at every analysis frame from then on. Playing ratio * freq
+    for every track resynthesizes the sound at any pitch.
+
+    Tracks are assigned to lanes so that tracks in the same lane never
+    overlap in time; a player needs one oscillator (or addBank partial) per
+    lane, not per track.
+
+    File layout (host byte order):
+
+        Header      magic "PTK1", version, numTracks, numFrames, hop in
+                    seconds, f0 in Hz, peak amplitude
+        per track   start frame, length in frames, frequency ratio, then
+                    length amplitude bytes
+
+    An amplitude byte v is peak * 10^(-v/40), half a decibel per step below
+    the loudest partial; 255 is silence.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct PartialTrack {
+    uint32_t start = 0;         ///< first frame
+    float ratio = 1;            ///< frequency / f0
+    std::vector<uint8_t> amps;  ///< one code per frame
+    unsigned lane = 0;
+
+    uint32_t end() const { return start + uint32_t(amps.size()); }
+};
+
+class PartialTracks {
+public:
+
+    static const uint8_t kSilent = 255;
+
+    /// Read a file written by save(); returns false on any error
+    bool load(const std::string& path){
+        FILE * f = std::fopen(path.c_str(), "rb");
+        if(!f) return false;
+        Header h;
+        bool ok = std::fread(&h, sizeof(h), 1, f) == 1 && h.magic == kMagic && h.version == kVersion;
+        std::vector<PartialTrack> tracks;
+        for(uint32_t i=0; ok && i<h.numTracks; ++i){
+            TrackHeader t;
+            ok = std::fread(&t, sizeof(t), 1, f) == 1 && t.length <= h.numFrames
+              && t.start <= h.numFrames - t.length;
+            if(!ok) break;
+            PartialTrack p;
+            p.start = t.start;
+            p.ratio = t.ratio;
+            p.amps.resize(t.length);
+            ok = std::fread(p.amps.data(), 1, t.length, f) == t.length;
+            tracks.push_back(std::move(p));
+        }
+        std::fclose(f);
+        if(!ok){
+            std::printf("PartialTracks: could not read %s\n", path.c_str());
+            return false;
+        }
+        mTracks = std::move(tracks);
+        mNumFrames = h.numFrames;
+        mHop = h.hop;
+        mF0 = h.f0;
+        mPeak = h.peak;
+        assignLanes();
+        return true;
+    }
+
+    /// Write tracks; returns false on any I/O error
+    bool save(const std::string& path) const {
+        FILE * f = std::fopen(path.c_str(), "wb");
+        if(!f) return false;
+        Header h {kMagic, kVersion, uint32_t(mTracks.size()), mNumFrames, mHop, mF0, mPeak};
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+        for(auto& p : mTracks){
+            if(!ok) break;
+            TrackHeader t {p.start, uint32_t(p.amps.size()), p.ratio};
+            ok = std::fwrite(&t, sizeof(t), 1, f) == 1
+              && std::fwrite(p.amps.data(), 1, p.amps.size(), f) == p.amps.size();
+        }
+        return (std::fclose(f) == 0) && ok;
+    }
+
+    /// Set contents, e.g. from an analysis
+    void set(std::vector<PartialTrack> tracks, uint32_t numFrames, float hop, float f0, float peak){
+        mTracks = std::move(tracks);
+        mNumFrames = numFrames;
+        mHop = hop;
+        mF0 = f0;
+        mPeak = peak;
+        assignLanes();
+    }
+
+    const std::vector<PartialTrack>& tracks() const { return mTracks; }
+    unsigned numTracks() const { return mTracks.size(); }
+    uint32_t numFrames() const { return mNumFrames; }
+    float hop() const { return mHop; }          ///< seconds between frames
+    float duration() const { return mNumFrames * mHop; }
+    float f0() const { return mF0; }
+    float peak() const { return mPeak; }
+
+    /// Number of lanes; tracks in a lane do not overlap
+    unsigned numLanes() const { return mLanes.size(); }
+
+    /// Indices of the tracks in a lane, in time order
+    const std::vector<unsigned>& lane(unsigned i) const { return mLanes[i]; }
+
+    /// Amplitude of a track at a fractional frame, 0 outside the track
+    float amplitude(const PartialTrack& p, float frame) const {
+        if(frame < p.start) return 0.f;
+        float x = frame - p.start;
+        unsigned i = unsigned(x);
+        if(i >= p.amps.size()) return 0.f;
+        float a = decode(p.amps[i]);
+        float b = i+1 < p.amps.size() ? decode(p.amps[i+1]) : 0.f;
+        return a + (b - a) * (x - i);
+    }
+
+    float decode(uint8_t v) const { return v == kSilent ? 0.f : mPeak * std::pow(10.f, -v / 40.f); }
+
+    uint8_t encode(float a) const {
+        if(a <= 0.f || mPeak <= 0.f) return kSilent;
+        float v = std::round(-40.f * std::log10(a / mPeak));
+        return v < 0.f ? 0 : (v >= kSilent ? kSilent : uint8_t(v));
+    }
+
+private:
+    static const uint32_t kMagic = 0x314B5450;     // "PTK1"
+    static const uint32_t kVersion = 1;
+
+    struct Header {
+        uint32_t magic, version, numTracks, numFrames;
+        float hop, f0, peak;
+    };
+    struct TrackHeader {
+        uint32_t start, length;
+        float ratio;
+    };
+
+    std::vector<PartialTrack> mTracks;
+    std::vector<std::vector<unsigned>> mLanes;
+    uint32_t mNumFrames = 0;
+    float mHop = 0, mF0 = 1, mPeak = 0;
+
+    // Put each track in the first lane that is free when it starts
+    void assignLanes(){
+        std::vector<unsigned> order(mTracks.size());
+        for(unsigned i=0; i<order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+            [this](unsigned a, unsigned b){ return mTracks[a].start < mTracks[b].start; });
+        mLanes.clear();
+        std::vector<uint32_t> laneEnd;
+        for(unsigned i : order){
+            PartialTrack& p = mTracks[i];
+            unsigned l = 0;
+            while(l < laneEnd.size() && laneEnd[l] > p.start) ++l;
+            if(l == laneEnd.size()){ laneEnd.push_back(0); mLanes.emplace_back(); }
+            laneEnd[l] = p.end();
+            mLanes[l].push_back(i);
+            p.lane = l;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef SYNTHTUTORIAL_DSP_PLUCKEDSTRINGBANK_HPP
+#define SYNTHTUTORIAL_DSP_PLUCKEDSTRINGBANK_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           PluckedStringBank.hpp
+    Description:    Many Karplus-Strong strings rendered together.
+
+    The PluckedString voices own a delay line, a moving average, a decay
+    envelope and a noise source each and run one sample at a time. The bank
+    keeps the state of all strings in flat arrays (structure of arrays) and
+    a single delay memory pool with one power-of-two ring per string.
+
+    A string is processed in chunks no longer than its delay, so none of the
+    samples read in a chunk were written in the same chunk. Within a chunk
+    the read, the two-point average and the write are independent per
+    sample and the loop vectorizes.
+
+    pluck() and release() may be called from any thread; the audio thread
+    picks up new strings at the start of the next render(). pluck() returns
+    a handle tagged with the string's generation, which changes every time
+    the string is plucked, so a handle kept after its string has been
+    retired and plucked again by someone else is simply no longer active().
+*/
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Gamma/Domain.h"
+#include "BlockNoise.hpp"
+
+class PluckedStringBank : public gam::DomainObserver {
+public:
+
+    /// A plucked string, valid until the string is retired
+    struct Handle {
+        int index = -1;
+        uint32_t generation = 0;
+    };
+
+    /// @param[in] numStrings   maximum number of simultaneous strings
+    /// @param[in] minFreq      lowest playable frequency
+    /// @param[in] maxBlock     longest block rendered in one pass; longer
+    ///                         blocks are rendered in several
+    PluckedStringBank(unsigned numStrings=256, float minFreq=27.5, unsigned maxBlock=8192)
+    :   mNumStrings(numStrings), mMinFreq(minFreq),
+        mState(new std::atomic<uint32_t>[numStrings])
+    {
+        for(unsigned i=0; i<mNumStrings; ++i) mState[i] = FREE;
+        mFreq.resize(mNumStrings);
+        mExcDecay.resize(mNumStrings);
+        mRelease.resize(mNumStrings);
+        mDelay.resize(mNumStrings);
+        mWrite.resize(mNumStrings);
+        mPrev.resize(mNumStrings);
+        mExc.resize(mNumStrings);
+        mExcMul.resize(mNumStrings);
+        mEnv.resize(mNumStrings);
+        mEnvMul.resize(mNumStrings);
+        mGainL.resize(mNumStrings);
+        mGainR.resize(mNumStrings);
+        mReleased.resize(mNumStrings);
+        // Scratch buffers are sized here, never on the audio thread
+        mMaxBlock = maxBlock ? maxBlock : 1;
+        mScratch.resize(mMaxBlock); mInput.resize(mMaxBlock); mNoise.resize(mMaxBlock);
+        allocate();
+    }
+
+    ~PluckedStringBank(){ delete[] mState; }
+
+    /// Start a new string
+
+    /// @param[in] freq     frequency
+    /// @param[in] amp      amplitude
+    /// @param[in] pan      stereo position in [-1, 1]
+    /// @param[in] decay    -60 dB time of the noise burst
+    /// @param[in] release  -60 dB time of the fade after release()
+    /// \returns handle of the string, with index -1 if all strings are in use
+    Handle pluck(float freq, float amp, float pan=0, float decay=0.1, float release=3){
+        for(unsigned i=0; i<mNumStrings; ++i){
+            uint32_t expect = mState[i].load(std::memory_order_relaxed);
+            if(stateOf(expect) != FREE) continue;
+            uint32_t gen = (generationOf(expect) + 1) & kGenerationMask;
+            if(mState[i].compare_exchange_strong(expect, pack(gen, CLAIMED))){
+                mFreq[i] = freq;
+                mExcDecay[i] = decay;
+                mRelease[i] = release;
+                float theta = (pan + 1.f) * float(M_PI) * 0.25f;
+                mGainL[i] = amp * std::cos(theta);
+                mGainR[i] = amp * std::sin(theta);
+                mState[i].store(pack(gen, PENDING), std::memory_order_release);
+                Handle h;
+                h.index = int(i);
+                h.generation = gen;
+                return h;
+            }
+        }
+        return Handle();
+    }
+
+    /// Start fading out a string; does nothing if it was already retired
+    void release(const Handle& h){
+        if(!valid(h)) return;
+        uint32_t expect = pack(h.generation, ACTIVE);
+        if(!mState[h.index].compare_exchange_strong(expect, pack(h.generation, RELEASED))){
+            // Not started yet; release as soon as it starts
+            expect = pack(h.generation, PENDING);
+            mState[h.index].compare_exchange_strong(expect, pack(h.generation, PENDING_RELEASE));
+        }
+    }
+
+    /// Whether a string is still sounding (or about to)
+    bool active(const Handle& h) const {
+        if(!valid(h)) return false;
+        uint32_t s = mState[h.index].load();
+        return generationOf(s) == h.generation && stateOf(s) != FREE;
+    }
+
+    /// Number of strings currently sounding
+    unsigned numActive() const {
+        unsigned n = 0;
+        for(unsigned i=0; i<mNumStrings; ++i) n += stateOf(mState[i].load()) != FREE;
+        return n;
+    }
+
+    /// Silence threshold below which a string is retired
+    void threshold(float v){ mThreshold = v; }
+
+    /// Add all strings into a stereo output buffer
+    void render(float * outL, float * outR, unsigned n){
+        for(unsigned i=0; i<n; i+=mMaxBlock){
+            renderBlock(outL + i, outR + i, n - i < mMaxBlock ? n - i : mMaxBlock);
+        }
+    }
+
+    void onDomainChange(double){ allocate(); }
+
+protected:
+    // The state word of a string packs its generation above its state
+    enum { FREE=0, CLAIMED, PENDING, PENDING_RELEASE, ACTIVE, RELEASED };
+    static const unsigned kStateBits = 3;
+    static const uint32_t kGenerationMask = (uint32_t(1) << (32 - kStateBits)) - 1;
+
+    static uint32_t pack(uint32_t generation, int state){ return generation << kStateBits | uint32_t(state); }
+    static int stateOf(uint32_t s){ return int(s & ((1u << kStateBits) - 1)); }
+    static uint32_t generationOf(uint32_t s){ return s >> kStateBits; }
+
+    bool valid(const Handle& h) const { return h.index >= 0 && unsigned(h.index) < mNumStrings; }
+
+    unsigned mNumStrings;
+    float mMinFreq;
+    float mThreshold = 1e-5f;
+    unsigned mMaxBlock;
+    std::atomic<uint32_t> * mState;
+
+    // Trigger parameters, written by pluck()
+    std::vector<float> mFreq, mExcDecay, mRelease;
+
+    // Per-string processing state
+    std::vector<unsigned> mDelay;       // delay length in samples
+    std::vector<unsigned> mWrite;       // write head
+    std::vector<float> mPrev;           // previous input of the averaging filter
+    std::vector<float> mExc, mExcMul;   // noise burst envelope
+    std::vector<float> mEnv, mEnvMul;   // release envelope
+    std::vector<float> mGainL, mGainR;
+    std::vector<char> mReleased;
+
+    // Delay memory, one ring of mRingSize samples per string
+    std::vector<float> mPool;
+    unsigned mRingSize = 0, mRingMask = 0;
+
+    std::vector<float> mScratch, mInput, mNoise;
+    BlockNoise mNoiseGen;
+
+    void allocate(){
+        unsigned len = unsigned(std::ceil(spu() / mMinFreq)) + 1;
+        mRingSize = 1;
+        while(mRingSize < len) mRingSize <<= 1;
+        mRingMask = mRingSize - 1;
+        mPool.assign(size_t(mRingSize) * mNumStrings, 0.f);
+    }
+
+    static float t60Mul(float t60, double spu){
+        return t60 > 0 ? float(std::pow(0.001, 1. / (t60 * spu))) : 0.f;
+    }
+    float t60Mul(float t60) const { return t60Mul(t60, spu()); }
+
+    void renderBlock(float * outL, float * outR, unsigned n){
+        for(unsigned s=0; s<mNumStrings; ++s){
+            uint32_t word = mState[s].load(std::memory_order_acquire);
+            const uint32_t gen = generationOf(word);
+            int state = stateOf(word);
+            if(state == FREE || state == CLAIMED) continue;
+            if(state == PENDING){
+                start(s);
+                if(!mState[s].compare_exchange_strong(word, pack(gen, ACTIVE))){
+                    // Released while we were starting it
+                    state = RELEASED;
+                    mState[s].store(pack(gen, RELEASED), std::memory_order_release);
+                }
+            }
+            else if(state == PENDING_RELEASE){
+                // Note off came with the note on: start and release at once
+                start(s);
+                state = RELEASED;
+                mState[s].store(pack(gen, RELEASED), std::memory_order_release);
+            }
+            if(state == RELEASED && !mReleased[s]){
+                mReleased[s] = 1;
+                mEnvMul[s] = t60Mul(mRelease[s]);
+            }
+            if(renderString(s, outL, outR, n) < mThreshold){
+                mState[s].store(pack(gen, FREE), std::memory_order_release);
+            }
+        }
+    }
+
+    void start(unsigned s){
+        float * ring = &mPool[size_t(s) * mRingSize];
+        for(unsigned i=0; i<mRingSize; ++i) ring[i] = 0.f;
+        float len = spu() / (mFreq[s] > mMinFreq ? mFreq[s] : mMinFreq);
+        mDelay[s] = len < 1.f ? 1u : unsigned(len);     // truncate, like ipl::Trunc
+        mWrite[s] = 0;
+        mPrev[s] = 0.f;
+        mExc[s] = 1.f;
+        mExcMul[s] = t60Mul(mExcDecay[s]);
+        mEnv[s] = 1.f;
+        mEnvMul[s] = 1.f;
+        mReleased[s] = 0;
+    }
+
+    // Render one string, returns its block peak
+    float renderString(unsigned s, float * outL, float * outR, unsigned n){
+        float * ring = &mPool[size_t(s) * mRingSize];
+        float * y = mScratch.data();
+        const unsigned mask = mRingMask;
+        const unsigned delay = mDelay[s];
+        unsigned w = mWrite[s];
+        float prev = mPrev[s];
+
+        // Noise burst; skipped once it has decayed away
+        float * exc = nullptr;
+        if(mExc[s] > 1e-6f){
+            exc = mNoise.data();
+            mNoiseGen.fill(exc, n);
+            float e = mExc[s], mul = mExcMul[s];
+            for(unsigned i=0; i<n; ++i){ exc[i] *= e; e *= mul; }
+            mExc[s] = e;
+        }
+
+        // Same recursion as PluckedString: out = delay(fil(delay() + in))
+        float * x = exc ? mInput.data() : y;
+        for(unsigned i0=0; i0<n; i0+=delay){
+            unsigned m = n - i0 < delay ? n - i0 : delay;
+            // Delay taps: nothing read here was written in this chunk
+            for(unsigned i=0; i<m; ++i){
+                y[i0+i] = ring[(w + i - delay) & mask];
+            }
+            if(exc){
+                for(unsigned i=0; i<m; ++i) x[i0+i] = y[i0+i] + exc[i0+i];
+            }
+            // Two-point moving average written back into the ring
+            ring[w & mask] = 0.5f * (x[i0] + prev);
+            for(unsigned i=1; i<m; ++i){
+                ring[(w + i) & mask] = 0.5f * (x[i0+i] + x[i0+i-1]);
+            }
+            prev = x[i0+m-1];
+            w += m;
+        }
+        mWrite[s] = w;
+        mPrev[s] = prev;
+
+        float env = mEnv[s], envMul = mEnvMul[s];
+        float gl = mGainL[s], gr = mGainR[s];
+        float peak = 0.f;
+        for(unsigned i=0; i<n; ++i){
+            float v = y[i] * env;
+            env *= envMul;
+            peak = std::fabs(v) > peak ? std::fabs(v) : peak;
+            outL[i] += v * gl;
+            outR[i] += v * gr;
+        }
+        mEnv[s] = env;
+        // Keep the string while the burst has not yet passed through the delay
+        return (mExc[s] > 1e-6f || w < 2*delay) ? 1.f : peak;
+    }
+};
+
+#endif
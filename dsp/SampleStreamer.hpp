@@ -0,0 +1,426 @@
+#ifndef SYNTHTUTORIAL_DSP_SAMPLESTREAMER_HPP
+#define SYNTHTUTORIAL_DSP_SAMPLESTREAMER_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           SampleStreamer.hpp
+    Description:    Play long sound files from disk without loading them.
+
+    A StreamedSample keeps only the first kResidentFrames of a WAV file in
+    memory, the attack. A voice plays a sample through a SampleStream: the
+    attack is read from memory at once, and while it plays a background
+    prefetch thread, owned by the SampleStreamer, reads the rest of the file
+    into the stream's ring buffer a chunk at a time. The audio thread never
+    touches the disk, locks or allocates; if the disk falls behind it plays
+    silence for the missing frames and counts an underrun.
+
+        SampleStreamer streamer;
+        StreamedSample * s = streamer.load("rain.wav");     // not audio thread
+        SampleStream * st = streamer.newStream();           // once per voice
+        st->start(s);                                       // note on
+        unsigned n = st->read(L, R, frames);                // per block
+
+    start() may be called from any thread, e.g. from a voice triggered by
+    the GUI: it only posts the sample, and the voice's next read() or
+    playing() on the audio thread picks it up.
+
+    Each ring has one producer (the prefetch thread) and one consumer (the
+    voice). Starting a stream bumps its generation; the prefetch thread
+    tags the frames it has written with the generation it wrote them for,
+    so a voice never plays the tail of a previous note.
+
+    Files are played at their own rate; load() warns when it differs from
+    the rate passed to the streamer. WAV files with 16, 24 or 32-bit integer
+    or 32-bit float samples are read.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../engine/Denormals.hpp"
+
+/// Random-access reader of PCM and float WAV files
+class WavReader {
+public:
+
+    WavReader() = default;
+    WavReader(const WavReader&) = delete;
+    WavReader& operator=(const WavReader&) = delete;
+    ~WavReader(){ close(); }
+
+    /// Open a file and parse its header; returns false if unsupported
+    bool open(const std::string& path){
+        close();
+        mFd = ::open(path.c_str(), O_RDONLY);
+        if(mFd < 0) return false;
+        if(!parse()){ close(); return false; }
+        return true;
+    }
+
+    void close(){
+        if(mFd >= 0) ::close(mFd);
+        mFd = -1;
+    }
+
+    unsigned channels() const { return mChannels; }
+    unsigned sampleRate() const { return mSampleRate; }
+    uint64_t frames() const { return mFrames; }
+
+    /// Read interleaved frames from a frame position. Safe to call from
+    /// several threads at once. Returns the number of frames read.
+    unsigned read(uint64_t frame, float * dst, unsigned count) const {
+        if(frame >= mFrames) return 0;
+        count = unsigned(std::min<uint64_t>(count, mFrames - frame));
+        const unsigned bps = mBits / 8, stride = bps * mChannels;
+        const unsigned samples = count * mChannels;
+        // Read raw bytes into the end of dst and convert forwards in place;
+        // a converted float never overtakes the bytes still to be read
+        char * raw = reinterpret_cast<char *>(dst) + samples * (sizeof(float) - bps);
+        ssize_t want = ssize_t(count) * stride;
+        ssize_t got = pread(mFd, raw, want, mDataOffset + frame * stride);
+        if(got <= 0) return 0;
+        count = unsigned(got / stride);
+        for(unsigned i=0; i<count * mChannels; ++i){
+            const unsigned char * b = reinterpret_cast<const unsigned char *>(raw + i * bps);
+            float v;
+            if(mFloat){
+                std::memcpy(&v, b, 4);
+            }
+            else if(bps == 2){
+                v = float(int16_t(b[0] | b[1] << 8)) * (1.f / 32768.f);
+            }
+            else if(bps == 3){
+                int32_t s = int32_t(uint32_t(b[0]) << 8 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 24);
+                v = float(s) * (1.f / 2147483648.f);
+            }
+            else {
+                int32_t s = int32_t(uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24);
+                v = float(s) * (1.f / 2147483648.f);
+            }
+            dst[i] = v;
+        }
+        return count;
+    }
+
+private:
+    int mFd = -1;
+    unsigned mChannels = 0, mSampleRate = 0, mBits = 0;
+    bool mFloat = false;
+    uint64_t mFrames = 0, mDataOffset = 0;
+
+    static uint32_t u32(const unsigned char * b){ return b[0] | b[1] << 8 | b[2] << 16 | uint32_t(b[3]) << 24; }
+    static uint16_t u16(const unsigned char * b){ return uint16_t(b[0] | b[1] << 8); }
+
+    bool parse(){
+        unsigned char h[12];
+        if(pread(mFd, h, 12, 0) != 12) return false;
+        if(std::memcmp(h, "RIFF", 4) || std::memcmp(h+8, "WAVE", 4)) return false;
+        bool haveFormat = false;
+        uint64_t pos = 12;
+        unsigned char c[40];
+        for(;;){
+            if(pread(mFd, c, 8, pos) != 8) return false;
+            uint64_t size = u32(c+4);
+            if(!std::memcmp(c, "fmt ", 4)){
+                if(size < 16 || pread(mFd, c, std::min<uint64_t>(size, 40), pos+8) < 16) return false;
+                unsigned format = u16(c);
+                mChannels = u16(c+2);
+                mSampleRate = u32(c+4);
+                mBits = u16(c+14);
+                if(format == 0xFFFE && size >= 26) format = u16(c+24);  // extensible
+                mFloat = format == 3;
+                if(!(format == 1 && (mBits == 16 || mBits == 24 || mBits == 32))
+                && !(format == 3 && mBits == 32)) return false;
+                if(mChannels == 0) return false;
+                haveFormat = true;
+            }
+            else if(!std::memcmp(c, "data", 4)){
+                if(!haveFormat) return false;
+                mDataOffset = pos + 8;
+                mFrames = size / (mBits / 8 * mChannels);
+                return true;
+            }
+            pos += 8 + size + (size & 1);
+        }
+    }
+};
+
+
+/// A sound file with its attack resident in memory
+class StreamedSample {
+public:
+
+    static const unsigned kResidentFrames = 32768;
+
+    bool load(const std::string& path){
+        if(!mFile.open(path)) return false;
+        mPath = path;
+        mAttack.resize(std::min<uint64_t>(kResidentFrames, mFile.frames()) * mFile.channels());
+        unsigned n = mFile.read(0, mAttack.data(), residentFrames());
+        mAttack.resize(n * mFile.channels());
+        return true;
+    }
+
+    const std::string& path() const { return mPath; }
+    unsigned channels() const { return mFile.channels(); }
+    unsigned sampleRate() const { return mFile.sampleRate(); }
+    uint64_t frames() const { return mFile.frames(); }
+    unsigned residentFrames() const { return unsigned(mAttack.size() / std::max(1u, channels())); }
+    const float * attack() const { return mAttack.data(); }
+    const WavReader& file() const { return mFile; }
+
+private:
+    WavReader mFile;
+    std::string mPath;
+    std::vector<float> mAttack;
+};
+
+
+/// Playback position and ring buffer of one voice
+class SampleStream {
+public:
+
+    static const unsigned kRingFrames = 32768;     ///< power of two
+    static const unsigned kChunkFrames = 4096;     ///< frames per disk read
+
+    SampleStream(): mRing(kRingFrames * 2) {}
+
+    /// Play a sample from its start; safe from any thread
+    void start(const StreamedSample * s){
+        mStart.store(s ? s : stopped(), std::memory_order_release);
+    }
+
+    /// Stop streaming; the prefetch thread drops the ring
+    void stop(){ start(nullptr); }
+
+    /// Whether frames remain to be played; audio thread
+    bool playing(){
+        poll();
+        return mSample && mPos < mSample->frames();
+    }
+
+    /// Read up to n frames into L and R (mono is copied to both). Returns
+    /// the frames produced; fewer than n only at the end of the sample.
+    unsigned read(float * L, float * R, unsigned n){
+        if(!playing()) return 0;
+        const StreamedSample& s = *mSample;
+        const unsigned ch = s.channels();
+        n = unsigned(std::min<uint64_t>(n, s.frames() - mPos));
+        unsigned i = 0;
+
+        // Attack from memory
+        for(; i<n && mPos < s.residentFrames(); ++i, ++mPos){
+            const float * f = s.attack() + mPos * ch;
+            L[i] = f[0];
+            R[i] = f[ch > 1 ? 1 : 0];
+        }
+
+        // The rest from the ring, if the prefetch thread has written it
+        if(i < n){
+            uint64_t tag = mFilled.load(std::memory_order_acquire);
+            uint64_t end = tag >> kGenShift == (mGeneration.load(std::memory_order_relaxed) & kGenMask)
+                         ? tag & kFrameMask : 0;
+            for(; i<n && mPos < end; ++i, ++mPos){
+                const float * f = &mRing[(mPos & (kRingFrames-1)) * 2];
+                L[i] = f[0];
+                R[i] = f[1];
+            }
+            mConsumed.store(mPos, std::memory_order_release);
+            if(i < n){
+                mUnderruns.fetch_add(1, std::memory_order_relaxed);
+                for(; i<n; ++i, ++mPos){ L[i] = R[i] = 0.f; }
+                mConsumed.store(mPos, std::memory_order_release);
+            }
+        }
+        return n;
+    }
+
+    /// Blocks in which the disk did not keep up
+    unsigned underruns() const { return mUnderruns.load(); }
+
+private:
+    friend class SampleStreamer;
+
+    // mFilled packs the generation above the end frame written so far
+    static const unsigned kGenShift = 40;
+    static const uint64_t kFrameMask = (uint64_t(1) << kGenShift) - 1;
+    static const uint64_t kGenMask = (uint64_t(1) << (64 - kGenShift)) - 1;
+
+    std::vector<float> mRing;               // stereo frames
+    std::vector<float> mChunk;              // file frames before splitting, prefetch thread only
+
+    // Audio thread
+    const StreamedSample * mSample = nullptr;
+    uint64_t mPos = 0;
+
+    // Shared
+    std::atomic<const StreamedSample *> mStart {nullptr};     // posted by start()
+    std::atomic<const StreamedSample *> mRequest {nullptr};
+    std::atomic<uint64_t> mGeneration {0};
+    std::atomic<uint64_t> mConsumed {0};    // frames the voice is done with
+    std::atomic<uint64_t> mFilled {0};      // generation and end frame written
+    std::atomic<unsigned> mUnderruns {0};
+
+    // Prefetch thread
+    uint64_t mSeenGeneration = 0;
+    const StreamedSample * mFilling = nullptr;
+    uint64_t mFileFrame = 0;
+
+    // Stands for a posted stop(), since nullptr means nothing posted
+    static const StreamedSample * stopped(){
+        static const StreamedSample s;
+        return &s;
+    }
+
+    // Take a sample posted by start() and restart on it (audio thread)
+    void poll(){
+        if(!mStart.load(std::memory_order_relaxed)) return;
+        const StreamedSample * s = mStart.exchange(nullptr, std::memory_order_acquire);
+        if(!s) return;
+        if(s == stopped()) s = nullptr;
+        mSample = s;
+        mPos = 0;
+        mConsumed.store(s ? s->residentFrames() : 0, std::memory_order_relaxed);
+        mRequest.store(s, std::memory_order_relaxed);
+        mGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    // Fill at most one chunk; returns true if there is more to do
+    bool prefetch(){
+        uint64_t gen = mGeneration.load(std::memory_order_acquire);
+        if(gen != mSeenGeneration){
+            mSeenGeneration = gen;
+            mFilling = mRequest.load(std::memory_order_relaxed);
+            mFileFrame = mFilling ? mFilling->residentFrames() : 0;
+            mFilled.store((gen & kGenMask) << kGenShift | mFileFrame, std::memory_order_release);
+        }
+        if(!mFilling || mFileFrame >= mFilling->frames()) return false;
+
+        uint64_t consumed = mConsumed.load(std::memory_order_acquire);
+        uint64_t room = consumed + kRingFrames - mFileFrame;
+        if(room < kChunkFrames) return false;
+
+        const unsigned ch = mFilling->channels();
+        mChunk.resize(kChunkFrames * ch);
+        unsigned n = mFilling->file().read(mFileFrame, mChunk.data(), kChunkFrames);
+        if(n == 0){ mFileFrame = mFilling->frames(); return false; }    // short file
+        for(unsigned i=0; i<n; ++i){
+            float * f = &mRing[((mFileFrame + i) & (kRingFrames-1)) * 2];
+            f[0] = mChunk[i * ch];
+            f[1] = mChunk[i * ch + (ch > 1 ? 1 : 0)];
+        }
+        mFileFrame += n;
+        // Publish only if the voice has not restarted meanwhile
+        if(mGeneration.load(std::memory_order_acquire) == gen){
+            mFilled.store((gen & kGenMask) << kGenShift | mFileFrame, std::memory_order_release);
+        }
+        return true;
+    }
+};
+
+
+/// Owns the samples, the streams and the prefetch thread
+class SampleStreamer {
+public:
+
+    /// @param[in] sampleRate  rate the samples are expected to be at
+    /// @param[in] numStreams  streams allocated up front, one per voice
+    SampleStreamer(double sampleRate=48000, unsigned numStreams=64)
+    :   mSampleRate(sampleRate), mPool(numStreams)
+    {
+        for(auto& s : mPool) s.reset(new SampleStream);
+        mThread = std::thread([this]{ run(); });
+    }
+
+    ~SampleStreamer(){
+        mRunning = false;
+        mThread.join();
+    }
+
+    /// Load a WAV file; returns nullptr on failure. Not for the audio thread.
+    StreamedSample * load(const std::string& path){
+        std::unique_ptr<StreamedSample> s(new StreamedSample);
+        if(!s->load(path)){
+            std::printf("SampleStreamer: could not read %s\n", path.c_str());
+            return nullptr;
+        }
+        if(s->sampleRate() != unsigned(mSampleRate)){
+            std::printf("SampleStreamer: %s is at %u Hz and will play at %g Hz\n",
+                        path.c_str(), s->sampleRate(), mSampleRate);
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSamples.push_back(std::move(s));
+        return mSamples.back().get();
+    }
+
+    /// New stream for a voice; lives as long as the streamer
+
+    /// Streams come from the preallocated pool without locking or
+    /// allocating. Once the pool is used up they are allocated under a
+    /// lock, which is not for the audio thread; preallocate the voices.
+    SampleStream * newStream(){
+        unsigned i = mHandedOut.fetch_add(1, std::memory_order_relaxed);
+        if(i < mPool.size()) return mPool[i].get();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExtra.emplace_back(new SampleStream);
+        return mExtra.back().get();
+    }
+
+    unsigned numSamples() const { return mSamples.size(); }
+    StreamedSample * sample(unsigned i) const { return i < mSamples.size() ? mSamples[i].get() : nullptr; }
+
+    /// Total underruns over all streams
+    unsigned underruns() const {
+        unsigned n = 0;
+        for(auto& s : mPool) n += s->underruns();
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(auto& s : mExtra) n += s->underruns();
+        return n;
+    }
+
+private:
+    double mSampleRate;
+    std::vector<std::unique_ptr<StreamedSample>> mSamples;
+    std::vector<std::unique_ptr<SampleStream>> mPool;           // never resized
+    std::atomic<unsigned> mHandedOut {0};
+    std::vector<std::unique_ptr<SampleStream>> mExtra;          // beyond the pool
+    // Guards mSamples and mExtra. Held only briefly, never during disk
+    // reads; the audio thread only takes it if it asks for a stream
+    // beyond the pool.
+    mutable std::mutex mMutex;
+    std::atomic<bool> mRunning {true};
+    std::thread mThread;
+
+    void run(){
+        disableDenormals();
+        std::vector<SampleStream *> extra;
+        while(mRunning){
+            // Streams are never destroyed before the streamer, so the
+            // pointers stay valid after the lock is dropped
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                extra.clear();
+                for(auto& s : mExtra) extra.push_back(s.get());
+            }
+            bool busy = false;
+            for(auto& s : mPool) busy |= s->prefetch();
+            for(auto * s : extra) busy |= s->prefetch();
+            // A ring drains 4096 frames in about 85 ms at 48 kHz
+            if(!busy) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SYNTHTUTORIAL_DSP_SINEENVLANES_HPP
+#define SYNTHTUTORIAL_DSP_SINEENVLANES_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           SineEnvLanes.hpp
+    Description:    SineEnv voices as lanes of a SynthVoiceBank.
+
+    The same sound as SineEnv in synth1.cpp, a sine oscillator with a
+    linear attack/sustain/release envelope and a stereo pan, for L voices
+    at once. State is kept in arrays of L and the inner loop runs over the
+    lanes with no branches, so it vectorizes across voices. The sine is a
+    polynomial rather than Gamma's recursive oscillator, since a recursion
+    per lane would not vectorize as well.
+*/
+
+#include <cmath>
+
+template <unsigned L>
+class SineEnvLanes {
+public:
+
+    /// Trigger parameters of one voice
+    struct Params {
+        float frequency = 60;
+        float amplitude = 0.3;
+        float attackTime = 1;
+        float releaseTime = 3;
+        float pan = 0;
+    };
+
+    SineEnvLanes(){
+        for(unsigned l=0; l<L; ++l) clear(l);
+    }
+
+    void start(unsigned l, const Params& p, double spu){
+        mPhase[l] = 0.f;
+        mInc[l] = float(p.frequency / spu);
+        mLevel[l] = 0.f;
+        mTarget[l] = 1.f;
+        float a = float(p.attackTime * spu);
+        mSlope[l] = a > 1.f ? 1.f / a : 1.f;
+        mRelease[l] = p.releaseTime;
+        // Equal-power pan
+        float theta = (p.pan + 1.f) * float(M_PI) * 0.25f;
+        mGainL[l] = p.amplitude * std::cos(theta);
+        mGainR[l] = p.amplitude * std::sin(theta);
+    }
+
+    void release(unsigned l, double spu){
+        float r = float(mRelease[l] * spu);
+        mTarget[l] = 0.f;
+        mSlope[l] = -(r > 1.f ? mLevel[l] / r : mLevel[l]);
+    }
+
+    bool done(unsigned l) const {
+        return mTarget[l] == 0.f && mLevel[l] <= 0.f;
+    }
+
+    /// Add all lanes into a stereo output buffer
+    void process(float * outL, float * outR, unsigned n){
+        for(unsigned i=0; i<n; ++i){
+            float sumL = 0.f, sumR = 0.f;
+            for(unsigned l=0; l<L; ++l){
+                float ph = mPhase[l] + mInc[l];
+                ph -= ph >= 1.f ? 1.f : 0.f;
+                mPhase[l] = ph;
+
+                float lv = mLevel[l] + mSlope[l];
+                float t = mTarget[l];
+                lv = mSlope[l] >= 0.f ? (lv < t ? lv : t) : (lv > t ? lv : t);
+                mLevel[l] = lv;
+
+                float v = sine(ph) * lv;
+                sumL += v * mGainL[l];
+                sumR += v * mGainR[l];
+            }
+            outL[i] += sumL;
+            outR[i] += sumR;
+        }
+    }
+
+private:
+    float mPhase[L], mInc[L];
+    float mLevel[L], mSlope[L], mTarget[L];
+    float mRelease[L];
+    float mGainL[L], mGainR[L];
+
+    void clear(unsigned l){
+        mPhase[l] = mInc[l] = 0.f;
+        mLevel[l] = mSlope[l] = mTarget[l] = 0.f;
+        mRelease[l] = 0.f;
+        mGainL[l] = mGainR[l] = 0.f;
+    }
+
+    // sin(2 pi p) for p in [0, 1), error below 1e-5
+    static float sine(float p){
+        // Fold onto a quarter period: sin(pi z) with |z| <= 1/2
+        float z = 2.f * p - 1.f;            // [-1, 1), sin(2 pi p) = -sin(pi z)
+        float a = z < 0.f ? -z : z;
+        a = a > 0.5f ? 1.f - a : a;
+        float x = float(M_PI) * a;
+        float x2 = x * x;
+        float s = x * (1.f + x2 * (-1.f/6 + x2 * (1.f/120 + x2 * (-1.f/5040 + x2 * (1.f/362880)))));
+        return z < 0.f ? s : -s;
+    }
+};
+
+#endif
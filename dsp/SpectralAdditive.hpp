@@ -0,0 +1,222 @@
+#ifndef SYNTHTUTORIAL_DSP_SPECTRALADDITIVE_HPP
+#define SYNTHTUTORIAL_DSP_SPECTRALADDITIVE_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           SpectralAdditive.hpp
+    Description:    Additive synthesis of many partials with one inverse FFT
+                    per hop.
+
+    An oscillator per partial costs a sine per partial per sample, which
+    limits a voice to a handful of partials. Here every partial of every
+    voice is written into one spectrum per hop instead. The spectrum of a
+    sinusoid seen through a Blackman-Harris window is the window's transform
+    shifted to the partial's frequency; its main lobe spans 8 bins and the
+    rest is below -90 dB, so a partial costs 8 complex adds per hop. One
+    inverse FFT per hop (both channels share it, left in the real part and
+    right in the imaginary part) then turns all partials into a frame.
+
+    Each frame is divided by the window and crossfaded with a triangle into
+    its neighbours. Only the middle half of a frame is used, where the
+    window is large, and frames overlap by half of that, so amplitudes and
+    frequencies are interpolated linearly from hop to hop. With the default
+    1024-point frame the hop is 256 samples (5.3 ms at 48 kHz), which is
+    also the time resolution of envelopes; output is delayed by one hop.
+
+    Voices allocate a range of partial slots once and set each partial's
+    frequency and amplitude once per block:
+
+        int first = bank.allocate(9);               // in init()
+        bank.partial(first + i, freq, amp);         // in onProcess()
+        bank.render(L, R, n);                       // in the app's onSound()
+
+    A partial with zero amplitude costs nothing. Partials within 4 bins of
+    the Nyquist frequency are skipped.
+*/
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "Gamma/Domain.h"
+#include "FFT.hpp"
+
+class SpectralAdditive : public gam::DomainObserver {
+public:
+
+    static const int kLobe = 4;         ///< half width of the main lobe in bins
+
+    /// @param[in] maxPartials  number of partial slots
+    /// @param[in] frameSize    FFT size, a power of two
+    SpectralAdditive(unsigned maxPartials=4096, unsigned frameSize=1024)
+    :   mFFT(frameSize)
+    {
+        const unsigned N = mFFT.size();
+        mHop = N/4;
+        mFreq.assign(maxPartials, 0.f);
+        mAmp.assign(maxPartials, 0.f);
+        mGainL.assign(maxPartials, 0.f);
+        mGainR.assign(maxPartials, 0.f);
+        mPhase.assign(maxPartials, 0.);
+        mSpectrum.resize(N);
+        mOut.assign(2*mHop, 0.f);
+        mTail.assign(2*mHop, 0.f);
+        mOutPos = mHop;
+
+        // Periodic 4-term Blackman-Harris window centered on N/2
+        const double a[4] = {0.35875, 0.48829, 0.14128, 0.01168};
+        std::vector<double> w(N);
+        for(unsigned n=0; n<N; ++n){
+            double x = 2*M_PI*n/N;
+            w[n] = a[0] - a[1]*std::cos(x) + a[2]*std::cos(2*x) - a[3]*std::cos(3*x);
+        }
+
+        // Its transform, real and even since the window is centered,
+        // tabulated over the main lobe
+        mLobe.resize(kLobe*kLobeRes + 2);
+        for(unsigned j=0; j<mLobe.size(); ++j){
+            double d = double(j) / kLobeRes, sum = 0;
+            for(unsigned n=0; n<N; ++n) sum += w[n] * std::cos(2*M_PI*d*(double(n) - N/2) / N);
+            mLobe[j] = float(sum / N);  // the inverse FFT is not scaled
+        }
+
+        // The middle half of each frame: undo the window, then a triangle
+        // of length N/2 whose copies a hop apart sum to one
+        mPost.resize(2*mHop);
+        for(unsigned m=0; m<2*mHop; ++m){
+            double t = 1. - std::fabs(double(m) - mHop) / mHop;
+            mPost[m] = float(t / w[N/4 + m]);
+        }
+    }
+
+    /// Reserve count consecutive partial slots; returns the first or -1
+    ///
+    /// Call from one thread, preferably before audio starts. Slots are
+    /// published to render() only once they are initialized.
+    int allocate(unsigned count){
+        const unsigned first = mAllocated.load(std::memory_order_relaxed);
+        if(first + count > mFreq.size()) return -1;
+        for(unsigned i=first; i<first+count; ++i){
+            partial(i, 0.f, 0.f);
+            phase(i, 0.);
+            pan(i, 0.f);
+        }
+        mAllocated.store(first + count, std::memory_order_release);
+        return int(first);
+    }
+
+    /// Set a partial's frequency in Hz and peak amplitude
+    void partial(unsigned i, float freq, float amp){
+        mFreq[i] = freq;
+        mAmp[i] = amp;
+    }
+
+    /// Set a partial's position from -1 (left) to 1 (right), equal power
+    void pan(unsigned i, float pos){
+        float t = (pos + 1.f) * float(M_PI) / 4.f;
+        mGainL[i] = std::cos(t);
+        mGainR[i] = std::sin(t);
+    }
+
+    /// Set a partial's phase in radians, e.g. at note on
+    void phase(unsigned i, double p){ mPhase[i] = p; }
+
+    /// Add n samples of all partials into L and R
+    void render(float * L, float * R, unsigned n){
+        unsigned i = 0;
+        while(i < n){
+            if(mOutPos == mHop){ synthesize(); mOutPos = 0; }
+            unsigned k = n - i < mHop - mOutPos ? n - i : mHop - mOutPos;
+            const float * l = &mOut[mOutPos];
+            const float * r = &mOut[mHop + mOutPos];
+            for(unsigned j=0; j<k; ++j){
+                L[i+j] += l[j];
+                R[i+j] += r[j];
+            }
+            i += k;
+            mOutPos += k;
+        }
+    }
+
+    unsigned frameSize() const { return mFFT.size(); }
+    unsigned hop() const { return mHop; }
+    unsigned numAllocated() const { return mAllocated.load(std::memory_order_relaxed); }
+
+    /// Partials sounding in the last frame
+    unsigned numActive() const { return mActive; }
+
+private:
+    static const unsigned kLobeRes = 64;   // table entries per bin
+
+    FFT mFFT;
+    unsigned mHop;
+    std::atomic<unsigned> mAllocated {0};
+    unsigned mActive = 0;
+    std::vector<float> mFreq, mAmp, mGainL, mGainR;
+    std::vector<double> mPhase;
+    std::vector<FFT::Complex> mSpectrum;
+    std::vector<float> mLobe, mPost;
+    std::vector<float> mOut;    // finished hop, left then right
+    std::vector<float> mTail;   // second half of the last frame, left then right
+    unsigned mOutPos;
+
+    float lobe(float d) const {
+        d = std::fabs(d) * kLobeRes;
+        unsigned j = unsigned(d);
+        float f = d - j;
+        return mLobe[j] + (mLobe[j+1] - mLobe[j]) * f;
+    }
+
+    void synthesize(){
+        const int N = mFFT.size();
+        const float binsPerHz = float(N * ups());
+        const double hopRadPerHz = 2*M_PI * mHop * ups();
+        FFT::Complex * Z = mSpectrum.data();
+        for(int k=0; k<N; ++k) Z[k] = 0.f;
+
+        mActive = 0;
+        const unsigned allocated = mAllocated.load(std::memory_order_acquire);
+        for(unsigned p=0; p<allocated; ++p){
+            const float b = mFreq[p] * binsPerHz;
+            if(mAmp[p] != 0.f && b > 0.f && b < N/2 - kLobe){
+                ++mActive;
+                // Bin k of a partial at bin b is a/2 (-1)^k e^(i phase) W(k-b)
+                const float h = 0.5f * mAmp[p];
+                const float c = h * float(std::cos(mPhase[p])), s = h * float(std::sin(mPhase[p]));
+                const float gl = mGainL[p], gr = mGainR[p];
+                int k = int(std::ceil(b - kLobe));
+                if(float(k) == b - kLobe) ++k;
+                for(; k < b + kLobe; ++k){
+                    float W = lobe(k - b);
+                    if(k & 1) W = -W;
+                    const float re = c*W, im = s*W;
+                    // Add (re + i im)(gl + i gr) at k and its conjugate
+                    // times (gl + i gr) at -k, for the two real channels
+                    FFT::Complex& zp = Z[k & (N-1)];
+                    FFT::Complex& zn = Z[-k & (N-1)];
+                    zp += FFT::Complex(re*gl - im*gr, re*gr + im*gl);
+                    zn += FFT::Complex(re*gl + im*gr, re*gr - im*gl);
+                }
+            }
+            mPhase[p] = std::fmod(mPhase[p] + mFreq[p] * hopRadPerHz, 2*M_PI);
+        }
+
+        mFFT.inverse(Z);
+
+        // Finish this hop with the first half of the frame's middle and keep
+        // the second half for the next hop
+        const FFT::Complex * x = Z + N/4;
+        float * outL = &mOut[0], * outR = &mOut[mHop];
+        float * tailL = &mTail[0], * tailR = &mTail[mHop];
+        for(unsigned m=0; m<mHop; ++m){
+            outL[m] = tailL[m] + x[m].real() * mPost[m];
+            outR[m] = tailR[m] + x[m].imag() * mPost[m];
+        }
+        for(unsigned m=0; m<mHop; ++m){
+            tailL[m] = x[mHop + m].real() * mPost[mHop + m];
+            tailR[m] = x[mHop + m].imag() * mPost[mHop + m];
+        }
+    }
+};
+
+#endif
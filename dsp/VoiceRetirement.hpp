@@ -0,0 +1,132 @@
+#ifndef SYNTHTUTORIAL_DSP_VOICERETIREMENT_HPP
+#define SYNTHTUTORIAL_DSP_VOICERETIREMENT_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           VoiceRetirement.hpp
+    Description:    Decide when a released voice has become inaudible.
+
+    Voices used to run a gam::EnvFollow on every output sample and free
+    themselves once its value fell below a fixed 0.001. The one-pole
+    follower lags the signal, so voices stayed alive well into inaudible
+    tails, and it cost a filter per sample.
+
+    Now a voice keeps the peak of its output over the current block
+    (BlockPeak) and asks the shared VoiceRetirement at the end of the block
+    whether that peak is silent. Silence is a threshold in dB relative to
+    the level of the master mix, with an absolute floor, so a quiet tail is
+    dropped as soon as it is masked by the rest of the mix. The app reports
+    the mix level once per block with observeMix().
+*/
+
+#include <cmath>
+
+/// Peak absolute value of a buffer
+inline float blockPeak(const float * x, unsigned n){
+    // Independent accumulators so the loop vectorizes
+    float acc[8] = {0,0,0,0,0,0,0,0};
+    unsigned i = 0;
+    for(; i+8 <= n; i+=8){
+        for(unsigned k=0; k<8; ++k){
+            float a = std::fabs(x[i+k]);
+            acc[k] = a > acc[k] ? a : acc[k];
+        }
+    }
+    for(; i<n; ++i){
+        float a = std::fabs(x[i]);
+        acc[0] = a > acc[0] ? a : acc[0];
+    }
+    float m = 0.f;
+    for(unsigned k=0; k<8; ++k) m = acc[k] > m ? acc[k] : m;
+    return m;
+}
+
+/// Root mean square of a buffer
+inline float blockRms(const float * x, unsigned n){
+    float acc[8] = {0,0,0,0,0,0,0,0};
+    unsigned i = 0;
+    for(; i+8 <= n; i+=8){
+        for(unsigned k=0; k<8; ++k) acc[k] += x[i+k] * x[i+k];
+    }
+    for(; i<n; ++i) acc[0] += x[i] * x[i];
+    float s = 0.f;
+    for(unsigned k=0; k<8; ++k) s += acc[k];
+    return n ? std::sqrt(s / n) : 0.f;
+}
+
+
+/// Peak of a voice's output over one block
+class BlockPeak {
+public:
+    /// Add next output sample
+    void operator()(float s){
+        float a = std::fabs(s);
+        mAcc = a > mAcc ? a : mAcc;
+    }
+
+    /// Latch the peak of the block just rendered and start a new one
+    float endBlock(){ mValue = mAcc; mAcc = 0.f; return mValue; }
+
+    /// Peak of the last complete block
+    float value() const { return mValue; }
+
+private:
+    float mAcc = 0.f;
+    float mValue = 0.f;
+};
+
+
+/// Shared silence threshold that follows the master mix
+class VoiceRetirement {
+public:
+
+    /// Set silence threshold relative to the mix level, in dB
+    void thresholdDb(float db){ mRel = std::pow(10.f, db/20.f); update(); }
+
+    /// Set absolute silence floor, in dBFS
+    void floorDb(float db){ mFloor = std::pow(10.f, db/20.f); update(); }
+
+    /// Set how fast the mix level estimate falls, in seconds per 60 dB
+    void release(float t60, float blocksPerSecond){
+        mFall = std::pow(0.001f, 1.f / (t60 * blocksPerSecond));
+    }
+
+    /// Whether a voice block peak is inaudible
+    bool silent(float peak) const { return peak < mThreshold; }
+
+    /// Current threshold as an amplitude
+    float threshold() const { return mThreshold; }
+
+    /// Measure the mix; call once per block after all voices have rendered
+    template <class AudioIOData>
+    void observeMix(AudioIOData& io){
+        float peak = 0.f;
+        for(int c=0; c<int(io.channelsOut()); ++c){
+            float p = blockPeak(io.outBuffer(c), io.framesPerBuffer());
+            peak = p > peak ? p : peak;
+        }
+        mMix *= mFall;
+        mMix = peak > mMix ? peak : mMix;
+        update();
+    }
+
+private:
+    float mRel = 0.001f;        // -60 dB below the mix
+    float mFloor = 0.00003f;    // about -90 dBFS
+    float mFall = 0.99f;
+    float mMix = 0.f;
+    float mThreshold = 0.00003f;
+
+    void update(){
+        float t = mMix * mRel;
+        mThreshold = t > mFloor ? t : mFloor;
+    }
+};
+
+/// The retirement threshold shared by all voices of the app
+inline VoiceRetirement& voiceRetirement(){
+    static VoiceRetirement v;
+    return v;
+}
+
+#endif
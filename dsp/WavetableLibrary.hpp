@@ -0,0 +1,301 @@
+#ifndef SYNTHTUTORIAL_DSP_WAVETABLELIBRARY_HPP
+#define SYNTHTUTORIAL_DSP_WAVETABLELIBRARY_HPP
+
+/*    Synthesis tutorial - shared unit generators
+
+    File:           WavetableLibrary.hpp
+    Description:    Wavetables and multisample zones in one memory-mapped
+                    file.
+
+    Apps that build their tables with addSines() redo the work in every
+    process and keep a private copy of each table. A library file holds
+    named tables and sample zones with their metadata. WavetableLibrary maps
+    it read-only, so opening is instant whatever the size, pages are loaded
+    on first use, and every process on the host that opens the same file
+    shares one copy in the page cache. Table data is used in place:
+
+        WavetableLibrary lib;
+        if(lib.open("synth2-data/tables.wtl")) lib.attach("saw", tbSaw);
+
+    The tables must not be written to: the mapping is read-only.
+
+    WavetableLibraryWriter builds a file. It writes to a temporary name and
+    renames it, so a process opening the library never sees a partial file.
+
+    A library used as a cache of generated tables should carry a tag, a
+    version of the code that generated them. The app compares tag() with
+    its own and rebuilds on a mismatch, so a stale file never overrides
+    changed tables.
+
+    Layout (host byte order, all data offsets 64-byte aligned):
+
+        Header       magic, version, counts, offsets of the two entry
+                     arrays, content tag
+        TableEntry   numTables entries: name, size, data offset
+        ZoneEntry    numZones entries: name, sample format, key and velocity
+                     range, loop points, data offset
+        data         float samples; zones are interleaved by channel
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wtl {
+
+static const uint32_t kMagic = 0x314C5457;     // "WTL1"
+static const uint32_t kVersion = 2;
+static const unsigned kNameLength = 32;
+static const unsigned kAlign = 64;
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numTables;
+    uint32_t numZones;
+    uint64_t tablesOffset;      ///< byte offset of the TableEntry array
+    uint64_t zonesOffset;       ///< byte offset of the ZoneEntry array
+    uint64_t tag;               ///< set by the writer, e.g. a content version
+};
+
+struct TableEntry {
+    char name[kNameLength];     ///< null-terminated
+    uint32_t size;              ///< samples, a power of two
+    uint32_t reserved;
+    uint64_t offset;            ///< byte offset of the samples
+};
+
+struct ZoneEntry {
+    char name[kNameLength];     ///< null-terminated
+    uint64_t offset;            ///< byte offset of the interleaved samples
+    uint64_t frames;
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint64_t loopStart;         ///< in frames; loopEnd 0 means no loop
+    uint64_t loopEnd;
+    uint8_t rootKey;            ///< MIDI note recorded at original pitch
+    uint8_t lowKey, highKey;    ///< inclusive MIDI note range
+    uint8_t lowVel, highVel;    ///< inclusive velocity range
+    uint8_t reserved[3];
+};
+
+} // wtl::
+
+
+/// Read-only view of a memory-mapped library file
+class WavetableLibrary {
+public:
+
+    WavetableLibrary() = default;
+    WavetableLibrary(const WavetableLibrary&) = delete;
+    WavetableLibrary& operator=(const WavetableLibrary&) = delete;
+    ~WavetableLibrary(){ close(); }
+
+    /// Map a library file; returns false if it is missing or malformed
+    bool open(const std::string& path){
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(wtl::Header)){
+            void * p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if(p != MAP_FAILED){
+                mBase = static_cast<const char *>(p);
+                mBytes = st.st_size;
+            }
+        }
+        ::close(fd);    // the mapping stays valid
+        if(!mBase) return false;
+        if(!validate()){
+            std::fprintf(stderr, "WavetableLibrary: %s is not a valid library\n", path.c_str());
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close(){
+        if(mBase) munmap(const_cast<char *>(mBase), mBytes);
+        mBase = nullptr;
+        mBytes = 0;
+    }
+
+    bool isOpen() const { return mBase != nullptr; }
+
+    unsigned numTables() const { return isOpen() ? header().numTables : 0; }
+    unsigned numZones() const { return isOpen() ? header().numZones : 0; }
+
+    /// Content tag given to the writer, 0 if none
+    uint64_t tag() const { return isOpen() ? header().tag : 0; }
+
+    const wtl::TableEntry& tableEntry(unsigned i) const { return tables()[i]; }
+    const wtl::ZoneEntry& zoneEntry(unsigned i) const { return zones()[i]; }
+
+    /// Samples of table i
+    const float * table(unsigned i) const { return samples(tables()[i].offset); }
+
+    /// Interleaved samples of zone i
+    const float * zone(unsigned i) const { return samples(zones()[i].offset); }
+
+    /// Index of the table with this name, or -1
+    int findTable(const char * name) const {
+        for(unsigned i=0; i<numTables(); ++i){
+            if(std::strncmp(tables()[i].name, name, wtl::kNameLength) == 0) return i;
+        }
+        return -1;
+    }
+
+    /// Index of the first zone covering a note and velocity, or -1
+    int findZone(int key, int vel=100) const {
+        for(unsigned i=0; i<numZones(); ++i){
+            const wtl::ZoneEntry& z = zones()[i];
+            if(key >= z.lowKey && key <= z.highKey && vel >= z.lowVel && vel <= z.highVel) return i;
+        }
+        return -1;
+    }
+
+    /// Point a Gamma array at a table's mapped samples without copying
+    template <class Array>
+    bool attach(const char * name, Array& dst) const {
+        int i = findTable(name);
+        if(i < 0) return false;
+        dst.source(const_cast<float *>(table(i)), tables()[i].size, false);
+        return true;
+    }
+
+private:
+    const char * mBase = nullptr;
+    size_t mBytes = 0;
+
+    const wtl::Header& header() const { return *reinterpret_cast<const wtl::Header *>(mBase); }
+    const wtl::TableEntry * tables() const {
+        return reinterpret_cast<const wtl::TableEntry *>(mBase + header().tablesOffset);
+    }
+    const wtl::ZoneEntry * zones() const {
+        return reinterpret_cast<const wtl::ZoneEntry *>(mBase + header().zonesOffset);
+    }
+    const float * samples(uint64_t offset) const {
+        return reinterpret_cast<const float *>(mBase + offset);
+    }
+
+    bool inside(uint64_t offset, uint64_t bytes) const {
+        return offset <= mBytes && bytes <= mBytes - offset;
+    }
+
+    // Check every offset once here so the accessors need no checks
+    bool validate() const {
+        const wtl::Header& h = header();
+        if(h.magic != wtl::kMagic || h.version != wtl::kVersion) return false;
+        if(!inside(h.tablesOffset, uint64_t(h.numTables) * sizeof(wtl::TableEntry))) return false;
+        if(!inside(h.zonesOffset, uint64_t(h.numZones) * sizeof(wtl::ZoneEntry))) return false;
+        if(h.tablesOffset % alignof(wtl::TableEntry) || h.zonesOffset % alignof(wtl::ZoneEntry)) return false;
+        for(unsigned i=0; i<h.numTables; ++i){
+            const wtl::TableEntry& t = tables()[i];
+            if(t.size == 0 || (t.size & (t.size-1))) return false;
+            if(t.offset % wtl::kAlign || !inside(t.offset, uint64_t(t.size) * sizeof(float))) return false;
+            if(t.name[wtl::kNameLength-1] != 0) return false;
+        }
+        for(unsigned i=0; i<h.numZones; ++i){
+            const wtl::ZoneEntry& z = zones()[i];
+            if(z.channels == 0 || z.channels > 64 || z.frames > mBytes) return false;
+            if(z.offset % wtl::kAlign || !inside(z.offset, z.frames * z.channels * sizeof(float))) return false;
+            if(z.name[wtl::kNameLength-1] != 0) return false;
+        }
+        return true;
+    }
+};
+
+
+/// Collects tables and zones and saves them as a library file
+class WavetableLibraryWriter {
+public:
+
+    /// Set the content tag stored in the header
+    void tag(uint64_t v){ mTag = v; }
+
+    /// Add a table; size must be a power of two
+    void addTable(const char * name, const float * src, uint32_t size){
+        wtl::TableEntry e {};
+        std::strncpy(e.name, name, wtl::kNameLength-1);
+        e.size = size;
+        mTables.push_back(e);
+        mTableData.emplace_back(src, src + size);
+    }
+
+    /// Add a table from a Gamma array
+    template <class Array>
+    void addTable(const char * name, const Array& src){
+        addTable(name, &src[0], src.size());
+    }
+
+    /// Add a zone; frames * channels interleaved samples are copied. Offset
+    /// is filled in by save().
+    void addZone(const wtl::ZoneEntry& zone, const float * src){
+        mZones.push_back(zone);
+        mZones.back().name[wtl::kNameLength-1] = 0;
+        mZoneData.emplace_back(src, src + zone.frames * zone.channels);
+    }
+
+    /// Write the library; returns false on any I/O error
+    bool save(const std::string& path) const {
+        wtl::Header h {};
+        h.magic = wtl::kMagic;
+        h.version = wtl::kVersion;
+        h.numTables = mTables.size();
+        h.numZones = mZones.size();
+        h.tag = mTag;
+        h.tablesOffset = align(sizeof(h));
+        h.zonesOffset = align(h.tablesOffset + mTables.size() * sizeof(wtl::TableEntry));
+
+        std::vector<wtl::TableEntry> tables = mTables;
+        std::vector<wtl::ZoneEntry> zones = mZones;
+        uint64_t pos = align(h.zonesOffset + mZones.size() * sizeof(wtl::ZoneEntry));
+        for(auto& t : tables){ t.offset = pos; pos = align(pos + t.size * sizeof(float)); }
+        for(unsigned i=0; i<zones.size(); ++i){
+            zones[i].offset = pos;
+            pos = align(pos + mZoneData[i].size() * sizeof(float));
+        }
+
+        std::string tmp = path + ".tmp";
+        FILE * f = std::fopen(tmp.c_str(), "wb");
+        if(!f) return false;
+        bool ok = put(f, 0, &h, sizeof(h))
+               && put(f, h.tablesOffset, tables.data(), tables.size() * sizeof(wtl::TableEntry))
+               && put(f, h.zonesOffset, zones.data(), zones.size() * sizeof(wtl::ZoneEntry));
+        for(unsigned i=0; ok && i<tables.size(); ++i){
+            ok = put(f, tables[i].offset, mTableData[i].data(), mTableData[i].size() * sizeof(float));
+        }
+        for(unsigned i=0; ok && i<zones.size(); ++i){
+            ok = put(f, zones[i].offset, mZoneData[i].data(), mZoneData[i].size() * sizeof(float));
+        }
+        ok = (std::fclose(f) == 0) && ok;
+        if(ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+        if(!ok) std::remove(tmp.c_str());
+        return ok;
+    }
+
+private:
+    std::vector<wtl::TableEntry> mTables;
+    std::vector<wtl::ZoneEntry> mZones;
+    std::vector<std::vector<float>> mTableData, mZoneData;
+    uint64_t mTag = 0;
+
+    static uint64_t align(uint64_t v){ return (v + wtl::kAlign - 1) & ~uint64_t(wtl::kAlign - 1); }
+
+    // Write at a byte offset, zero-filling any gap before it
+    static bool put(FILE * f, uint64_t offset, const void * src, size_t bytes){
+        long at = std::ftell(f);
+        if(at < 0) return false;
+        for(; uint64_t(at) < offset; ++at){ if(std::fputc(0, f) == EOF) return false; }
+        return bytes == 0 || std::fwrite(src, 1, bytes, f) == bytes;
+    }
+};
+
+#endif
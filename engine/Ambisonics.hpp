@@ -0,0 +1,318 @@
+#ifndef SYNTHTUTORIAL_ENGINE_AMBISONICS_HPP
+#define SYNTHTUTORIAL_ENGINE_AMBISONICS_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           Ambisonics.hpp
+    Description:    Encode voices into a higher-order Ambisonics bus and
+                    decode it once per block to the speakers.
+
+    Panning each voice to each speaker costs voices x speakers per sample.
+    Here a voice is encoded into the (order+1)^2 channels of an Ambisonics
+    bus (orders 1 to 5) by multiplying its block with one gain per channel,
+    the real spherical harmonics of its direction. The bus is decoded to
+    the speakers once per block by one matrix, so the cost is
+    voices x channels + channels x speakers.
+
+    Channels are in ACN order with SN3D normalization (AmbiX). Directions
+    are in degrees as in Vbap.hpp: azimuth positive to the left, elevation
+    positive upwards.
+
+    The decoder is AllRAD: the bus is decoded to a dense, even set of
+    virtual speakers, which are panned to the real layout with Vbap. This
+    works for irregular layouts and domes, where a decoder fitted to the
+    speakers directly would be unstable. Max-rE weights per order keep the
+    energy on the speakers nearest the source. For a flat layout (all
+    speakers at ear level) only the horizontal harmonics are decoded,
+    since height cannot be reproduced.
+
+    In the app:
+
+        hoaBus().init(3, layout);          // before audio starts
+        ...
+        hoaBus().begin(io.framesPerBuffer());
+        synthManager.render(io);           // voices encode into the bus
+        hoaBus().decode(io);
+
+    and in a voice, like VbapPanner:
+
+        while(io()){ ...; mEncoder(s); }
+        mEncoder.position(hoaBus(), azimuth, elevation);
+        mEncoder.render(hoaBus());
+
+    Encoding gains are computed once per block and glide over the block.
+    Every loop over a block multiplies and adds with no branches, which the
+    compiler vectorizes.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Vbap.hpp"
+
+/// Real spherical harmonics up to order, ACN order, SN3D normalization
+
+/// @param[out] out     (order+1)^2 values
+inline void hoaCoefficients(unsigned order, float azimuth, float elevation, float * out){
+    const double rad = 3.14159265358979 / 180.;
+    const double az = azimuth * rad, el = elevation * rad;
+    const double x = std::sin(el), c = std::cos(el);
+    for(unsigned m=0; m<=order; ++m){
+        // Associated Legendre functions P_n^m(x) for n = m..order, without
+        // the Condon-Shortley phase
+        double pmm = 1.;
+        for(unsigned k=1; k<=m; ++k) pmm *= (2.*k - 1.) * c;
+        double prev = 0., p = pmm;
+        for(unsigned n=m; n<=order; ++n){
+            if(n == m + 1) { prev = p; p = x * (2.*m + 1.) * pmm; }
+            else if(n > m + 1){
+                double next = ((2.*n - 1.) * x * p - (n + m - 1.) * prev) / (n - m);
+                prev = p; p = next;
+            }
+            // SN3D: sqrt((2 - delta_m) (n-m)! / (n+m)!)
+            double ratio = 1.;
+            for(unsigned k=n-m+1; k<=n+m; ++k) ratio /= k;
+            double norm = std::sqrt((m == 0 ? 1. : 2.) * ratio);
+            out[n*n + n + m] = float(norm * p * std::cos(m * az));
+            if(m > 0) out[n*n + n - m] = float(norm * p * std::sin(m * az));
+        }
+    }
+}
+
+
+/// Ambisonics bus and its decoder to a speaker layout
+class HoaBus {
+public:
+
+    static const unsigned kMaxOrder = 5;
+    static const unsigned kMaxChannels = (kMaxOrder+1) * (kMaxOrder+1);
+
+    /// Allocate the bus and build the decoder; call before audio starts
+
+    /// @param[in] order        1 to 5
+    /// @param[in] layout       speakers to decode to
+    /// @param[in] maxBlock     largest audio block
+    void init(unsigned order, const SpeakerLayout& layout, unsigned maxBlock=8192){
+        mOrder = std::min(std::max(order, 1u), kMaxOrder);
+        mChannels = (mOrder+1) * (mOrder+1);
+        mMaxBlock = maxBlock;
+        mBus.assign(size_t(mChannels) * maxBlock, 0.f);
+        mLayout = layout;
+        makeDecoder();
+    }
+
+    unsigned order() const { return mOrder; }
+    unsigned numChannels() const { return mChannels; }
+    unsigned frames() const { return mFrames; }
+    const SpeakerLayout& layout() const { return mLayout; }
+
+    /// Widest speaker azimuth in the front half, as Vbap::front()
+    float front() const { return mFront; }
+
+    /// Azimuth in degrees of a pan position in -1 (left) to 1 (right),
+    /// across the front of the layout as Vbap::azimuthOfPan()
+    float azimuthOfPan(float pan) const { return -pan * mFront; }
+
+    /// Samples of bus channel k (ACN) for the current block
+    float * channel(unsigned k){ return &mBus[size_t(k) * mMaxBlock]; }
+
+    /// Decoder gain from bus channel k to speaker l
+    float decoderGain(unsigned l, unsigned k) const { return mDecoder[size_t(l) * mChannels + k]; }
+
+    /// Clear the bus for a block of n samples
+    void begin(unsigned n){
+        mFrames = std::min(n, mMaxBlock);
+        for(unsigned k=0; k<mChannels; ++k) std::fill(channel(k), channel(k) + mFrames, 0.f);
+    }
+
+    /// Decode the block and add it into the speaker channels of io
+    template <class AudioIOData>
+    void decode(AudioIOData& io){
+        const std::vector<Speaker>& sp = mLayout.speakers();
+        const unsigned channels = io.channelsOut();
+        const unsigned n = mFrames;
+        for(unsigned l=0; l<sp.size(); ++l){
+            if(sp[l].channel >= channels) continue;
+            float * out = io.outBuffer(sp[l].channel);
+            for(unsigned k=0; k<mChannels; ++k){
+                const float g = decoderGain(l, k);
+                if(g == 0.f) continue;
+                const float * in = channel(k);
+                for(unsigned i=0; i<n; ++i) out[i] += in[i] * g;
+            }
+        }
+    }
+
+private:
+    unsigned mOrder = 1, mChannels = 4, mMaxBlock = 0, mFrames = 0;
+    float mFront = 30.f;
+    std::vector<float> mBus;        // mChannels blocks of mMaxBlock
+    std::vector<float> mDecoder;    // speakers x channels
+    SpeakerLayout mLayout;
+
+    // AllRAD decoder: the bus is sampled at many evenly spread virtual
+    // speakers (a projection; 480 points are dense enough up to order 5),
+    // and each virtual speaker is panned to the real ones with Vbap. Directions the layout
+    // does not cover, like below a dome, fold onto its nearest edge.
+    void makeDecoder(){
+        const std::vector<Speaker>& sp = mLayout.speakers();
+        const unsigned L = sp.size(), K = mChannels;
+        mDecoder.assign(size_t(L) * K, 0.f);
+        if(L == 0) return;
+
+        bool flat = true;
+        for(auto& s : sp) flat &= std::fabs(s.elevation) < 0.5f;
+
+        Vbap panner;
+        panner.layout(mLayout);
+        mFront = panner.front();
+
+        // Virtual speakers: a circle for a flat layout, otherwise a
+        // Fibonacci sphere
+        const double pi = 3.14159265358979;
+        const unsigned T = flat ? 72 : 480;
+        std::vector<float> az(T), el(T);
+        for(unsigned t=0; t<T; ++t){
+            if(flat){
+                az[t] = 360.f * t / T;
+                el[t] = 0.f;
+            }
+            else {
+                double z = 1. - (2.*t + 1.) / T;
+                az[t] = float(std::fmod(t * 137.50776405, 360.));
+                el[t] = float(std::asin(z) * 180. / pi);
+            }
+        }
+
+        // Projection weights of the SN3D harmonics, with max-rE per order:
+        // each harmonic is divided by its sum of squares over the virtual
+        // speakers, so that it projects back onto itself. On the circle only
+        // the horizontal ones (|m| = n) are used; the others cannot be told
+        // apart there.
+        double weight[kMaxOrder+1];
+        maxReWeights(flat, weight);
+        std::vector<double> proj(K, 0.);
+        float h[kMaxChannels];
+        for(unsigned t=0; t<T; ++t){
+            hoaCoefficients(mOrder, az[t], el[t], h);
+            for(unsigned k=0; k<K; ++k) proj[k] += double(h[k]) * h[k];
+        }
+        for(unsigned n=0; n<=mOrder; ++n){
+            for(int m=-int(n); m<=int(n); ++m){
+                unsigned k = n*n + n + m;
+                bool used = !flat || unsigned(std::abs(m)) == n;
+                proj[k] = used && proj[k] > 0. ? weight[n] / proj[k] : 0.;
+            }
+        }
+
+        std::vector<unsigned> index(panner.numChannels(), L);
+        for(unsigned l=0; l<L; ++l) index[sp[l].channel] = l;
+
+        for(unsigned t=0; t<T; ++t){
+            hoaCoefficients(mOrder, az[t], el[t], h);
+            VbapGains g = panner.gains(az[t], el[t]);
+            for(unsigned j=0; j<g.count; ++j){
+                unsigned l = index[g.channel[j]];
+                for(unsigned k=0; k<K; ++k){
+                    mDecoder[size_t(l) * K + k] += float(g.gain[j] * proj[k] * h[k]);
+                }
+            }
+        }
+
+        // Scale so that a source keeps, on average, unit power
+        double power = 0.;
+        for(unsigned t=0; t<T; ++t){
+            hoaCoefficients(mOrder, az[t], el[t], h);
+            for(unsigned l=0; l<L; ++l){
+                double s = 0.;
+                for(unsigned k=0; k<K; ++k) s += mDecoder[size_t(l) * K + k] * h[k];
+                power += s * s;
+            }
+        }
+        float scale = power > 0. ? float(std::sqrt(T / power)) : 1.f;
+        for(auto& d : mDecoder) d *= scale;
+    }
+
+    void maxReWeights(bool flat, double * w) const {
+        const double pi = 3.14159265358979;
+        const unsigned N = mOrder;
+        if(flat){
+            for(unsigned n=0; n<=N; ++n) w[n] = std::cos(n * pi / (2. * N + 2.));
+            return;
+        }
+        // Legendre polynomials at rE, the largest root of P_(N+1)
+        double r = std::cos(2.4068 / (N + 1.5116));
+        double p0 = 1., p1 = r;
+        w[0] = 1.;
+        if(N >= 1) w[1] = r;
+        for(unsigned n=2; n<=N; ++n){
+            double p2 = ((2.*n - 1.) * r * p1 - (n - 1.) * p0) / n;
+            w[n] = p2;
+            p0 = p1; p1 = p2;
+        }
+    }
+};
+
+/// The Ambisonics bus shared by all voices of the app
+inline HoaBus& hoaBus(){
+    static HoaBus b;
+    return b;
+}
+
+
+/// Per-voice Ambisonics encoder
+class HoaEncoder {
+public:
+
+    static const unsigned kMaxBlock = 8192;
+
+    /// Add next input sample to the block
+    void operator()(float s){
+        if(mFill < kMaxBlock) mIn[mFill++] = s;
+    }
+
+    /// Set the direction in degrees for the block being rendered
+    void position(const HoaBus& bus, float azimuth, float elevation=0.f){
+        mChannels = bus.numChannels();
+        hoaCoefficients(bus.order(), azimuth, elevation, mTarget);
+    }
+
+    /// Start the next block at the target gains instead of gliding;
+    /// call when the voice is triggered
+    void reset(){ mJump = true; }
+
+    /// Add the collected block, the last samples of the bus block, into
+    /// every bus channel
+    void render(HoaBus& bus){
+        const unsigned n = std::min(mFill, bus.frames());
+        const unsigned offset = bus.frames() - n;
+        mFill = 0;
+        if(mJump){
+            std::copy(mTarget, mTarget + mChannels, mCurrent);
+            mJump = false;
+        }
+        const float * in = mIn;
+        for(unsigned k=0; k<mChannels; ++k){
+            float * out = bus.channel(k) + offset;
+            const float from = mCurrent[k], to = mTarget[k];
+            if(from == to){
+                for(unsigned i=0; i<n; ++i) out[i] += in[i] * to;
+            }
+            else {
+                const float step = n ? (to - from) / n : 0.f;
+                for(unsigned i=0; i<n; ++i) out[i] += in[i] * (from + step * (i+1));
+            }
+            mCurrent[k] = to;
+        }
+    }
+
+private:
+    float mIn[kMaxBlock];
+    unsigned mFill = 0, mChannels = 0;
+    float mCurrent[HoaBus::kMaxChannels] = {};
+    float mTarget[HoaBus::kMaxChannels] = {};
+    bool mJump = true;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef SYNTHTUTORIAL_ENGINE_DENORMALS_HPP
+#define SYNTHTUTORIAL_ENGINE_DENORMALS_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           Denormals.hpp
+    Description:    Keep subnormal floats out of the audio path.
+
+    Recursive filters and feedback delays (Reson in Sub, the plucked string
+    loop, the comb and allpass reverbs) decay towards zero and end up in
+    subnormal floats, which many CPUs process tens of times slower. Voices
+    therefore get expensive exactly when they become inaudible.
+
+    DenormalGuard turns on flush-to-zero (results) and denormals-are-zero
+    (operands) for the current thread and restores the previous mode when
+    it goes out of scope. Put one at the top of every audio callback:
+
+        virtual void onSound(AudioIOData &io) override {
+            DenormalGuard noDenormals;
+            ...
+
+    Threads started by the app that process audio call disableDenormals()
+    once when they start.
+
+    Compiling with SYNTHTUTORIAL_COUNT_SUBNORMALS defined enables
+    COUNT_SUBNORMALS(className, value), which counts subnormal values per
+    voice class and prints a report at exit; without it the macro expands
+    to nothing. With the guard in place every count should stay at zero.
+*/
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SYNTHTUTORIAL_DENORMALS_SSE
+#endif
+
+class DenormalGuard {
+public:
+    DenormalGuard(): mSaved(getMode()) { setMode(mSaved | flushBits()); }
+    ~DenormalGuard(){ setMode(mSaved); }
+
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+    /// Floating-point control bits that flush subnormals on this CPU
+    static uint64_t flushBits(){
+    #if defined(SYNTHTUTORIAL_DENORMALS_SSE)
+        return 0x8040;          // MXCSR FTZ (bit 15) and DAZ (bit 6)
+    #elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FP))
+        return 1u << 24;        // FPCR/FPSCR FZ, flushes inputs and results
+    #else
+        return 0;
+    #endif
+    }
+
+    static uint64_t getMode(){
+    #if defined(SYNTHTUTORIAL_DENORMALS_SSE)
+        return _mm_getcsr();
+    #elif defined(__aarch64__)
+        uint64_t v; __asm__ __volatile__("mrs %0, fpcr" : "=r"(v)); return v;
+    #elif defined(__arm__) && defined(__ARM_FP)
+        uint32_t v; __asm__ __volatile__("vmrs %0, fpscr" : "=r"(v)); return v;
+    #else
+        return 0;
+    #endif
+    }
+
+    static void setMode(uint64_t v){
+    #if defined(SYNTHTUTORIAL_DENORMALS_SSE)
+        _mm_setcsr(unsigned(v));
+    #elif defined(__aarch64__)
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(v));
+    #elif defined(__arm__) && defined(__ARM_FP)
+        __asm__ __volatile__("vmsr fpscr, %0" : : "r"(uint32_t(v)));
+    #else
+        (void)v;
+    #endif
+    }
+
+private:
+    uint64_t mSaved;
+};
+
+/// Flush subnormals on the calling thread for the rest of its life
+inline void disableDenormals(){
+    DenormalGuard::setMode(DenormalGuard::getMode() | DenormalGuard::flushBits());
+}
+
+
+#ifdef SYNTHTUTORIAL_COUNT_SUBNORMALS
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+/// Debug counts of subnormal values per voice class
+class SubnormalCounter {
+public:
+
+    static const int kMaxClasses = 16;
+
+    ~SubnormalCounter(){ print(); }
+
+    /// Register a voice class by name and get its id
+    int voiceClass(const char * name){
+        std::lock_guard<std::mutex> lock(mRegister);
+        for(int i=0; i<mNumClasses; ++i){
+            if(0 == std::strcmp(mNames[i], name)) return i;
+        }
+        if(mNumClasses == kMaxClasses) return kMaxClasses - 1;
+        mNames[mNumClasses] = name;
+        return mNumClasses++;
+    }
+
+    /// Count a value; looks at the bits, so it works with DAZ enabled
+    void count(int cls, float v){
+        uint32_t b;
+        std::memcpy(&b, &v, sizeof b);
+        mValues[cls].fetch_add(1, std::memory_order_relaxed);
+        if((b & 0x7f800000u) == 0 && (b & 0x007fffffu) != 0){
+            mSubnormals[cls].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void print() const {
+        for(int i=0; i<mNumClasses; ++i){
+            std::printf("subnormals %-16s %llu of %llu values\n", mNames[i],
+                (unsigned long long)mSubnormals[i].load(),
+                (unsigned long long)mValues[i].load());
+        }
+    }
+
+private:
+    const char * mNames[kMaxClasses];
+    std::atomic<uint64_t> mValues[kMaxClasses] {};
+    std::atomic<uint64_t> mSubnormals[kMaxClasses] {};
+    int mNumClasses = 0;
+    std::mutex mRegister;
+};
+
+inline SubnormalCounter& subnormalCounter(){
+    static SubnormalCounter c;
+    return c;
+}
+
+#define COUNT_SUBNORMALS(className, value) do {\
+    static const int subnormalClass_ = subnormalCounter().voiceClass(className);\
+    subnormalCounter().count(subnormalClass_, value);\
+} while(0)
+
+#else
+
+#define COUNT_SUBNORMALS(className, value) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef SYNTHTUTORIAL_ENGINE_DETERMINISTIC_HPP
+#define SYNTHTUTORIAL_ENGINE_DETERMINISTIC_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           Deterministic.hpp
+    Description:    Reproducible randomness, so that two renders of the same
+                    sequence are identical.
+
+    Noise in voices and random choices in generative helpers make every
+    render different, which defeats caching rendered output, A/B timing
+    comparisons, and checking a parallel render against a serial one.
+
+    In deterministic mode:
+
+      - a voice reseeds its noise on every trigger from voiceSeed(id()),
+        a hash of the global seed and the event id. The noise then depends
+        only on the event, not on which pooled voice instance plays it, how
+        many notes that instance played before, or which thread renders it;
+      - generative helpers (random notes, random timing) draw from random(),
+        a SeededRandom started from the global seed, instead of
+        gam::rnd, whose state is shared with everything else in the
+        program.
+
+    The mode is on when the environment variable SYNTHTUTORIAL_SEED holds
+    the seed, e.g.
+
+        SYNTHTUTORIAL_SEED=1 ./run.sh synthesisTutorial/synth8.cpp
+
+    or after deterministic().enable(seed). Otherwise random() is seeded
+    from the clock and voices keep their own noise streams.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+/// Small, fast generator (xorshift64*) with a settable seed
+class SeededRandom {
+public:
+
+    SeededRandom(uint64_t s = 1){ seed(s); }
+
+    /// Reseed; the same seed always produces the same sequence
+    void seed(uint64_t v){
+        // Spread the seed so that nearby seeds give unrelated sequences
+        v += 0x9E3779B97F4A7C15ull;
+        v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+        v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+        v ^= v >> 31;
+        mState = v ? v : 0x9E3779B97F4A7C15ull;
+    }
+
+    /// Next 32 random bits
+    uint32_t next(){
+        mState ^= mState >> 12;
+        mState ^= mState << 25;
+        mState ^= mState >> 27;
+        return uint32_t((mState * 0x2545F4914F6CDD1Dull) >> 32);
+    }
+
+    /// Uniform in [0, 1)
+    float uni(){ return (next() >> 8) * (1.f / 16777216.f); }
+
+    /// Uniform in [a, b)
+    float uni(float a, float b){ return a + (b - a) * uni(); }
+
+    /// Uniform integer from the lower of a and b up to, not including,
+    /// the higher
+    int uni(int a, int b){
+        if(a > b){ int t = a; a = b; b = t; }
+        if(a == b) return a;
+        return a + int(next() % uint32_t(b - a));
+    }
+
+private:
+    uint64_t mState;
+};
+
+
+class Deterministic {
+public:
+
+    Deterministic(){
+        const char * env = std::getenv("SYNTHTUTORIAL_SEED");
+        if(env && *env) enable(uint32_t(std::strtoul(env, nullptr, 0)));
+        else mRandom.seed(uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+    }
+
+    /// Turn deterministic mode on with a global seed and restart random()
+    void enable(uint32_t seed){
+        mEnabled = true;
+        mSeed = seed;
+        mRandom.seed(seed);
+    }
+
+    void disable(){ mEnabled = false; }
+
+    bool enabled() const { return mEnabled; }
+    uint32_t seed() const { return mSeed; }
+
+    /// Seed of the voice playing an event
+    uint32_t voiceSeed(int eventId) const {
+        uint64_t x = (uint64_t(mSeed) << 32) ^ uint32_t(eventId);
+        x = (x ^ (x >> 33)) * 0xFF51AFD7ED558CCDull;
+        x = (x ^ (x >> 33)) * 0xC4CEB9FE1A85EC53ull;
+        return uint32_t(x ^ (x >> 33));
+    }
+
+    /// Generator for generative helpers; use from one thread (the GUI)
+    SeededRandom& random(){ return mRandom; }
+
+private:
+    bool mEnabled = false;
+    uint32_t mSeed = 0;
+    SeededRandom mRandom;
+};
+
+/// The deterministic mode shared by the whole app
+inline Deterministic& deterministic(){
+    static Deterministic d;
+    return d;
+}
+
+#endif
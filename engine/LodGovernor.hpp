@@ -0,0 +1,82 @@
+#ifndef SYNTHTUTORIAL_ENGINE_LODGOVERNOR_HPP
+#define SYNTHTUTORIAL_ENGINE_LODGOVERNOR_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           LodGovernor.hpp
+    Description:    Pick a voice quality tier from the callback headroom.
+
+    Voice classes can render at several levels of detail (tiers):
+
+        0   full quality
+        1   reduced
+        2   minimal
+
+    What a tier means is up to each voice, e.g. AddSyn drops its upper
+    partials and Sub lowers its DSF harmonics. The governor is updated once
+    per callback with the headroom measured by VoiceAdmission. It lowers the
+    quality when headroom falls below one threshold and raises it again only
+    above a higher one, holding each tier for a while so it does not flap.
+
+    Voices read tier() in onTriggerOn() and keep it for the whole note, so a
+    tier change never switches algorithms in the middle of a sound.
+*/
+
+#include <atomic>
+
+class LodGovernor {
+public:
+
+    static const int kNumTiers = 3;
+
+    /// Set headroom thresholds, as fractions of the callback period
+
+    /// @param[in] down     lower quality when headroom falls below this
+    /// @param[in] up       raise quality when headroom rises above this
+    void thresholds(float down, float up){ mDown = down; mUp = up; }
+
+    /// Set minimum number of callbacks between tier changes
+    void hold(unsigned blocks){ mHold = blocks; }
+
+    /// Force a tier, or -1 to let headroom decide
+    void force(int t){ mForce.store(t); }
+
+    /// Update from the measured headroom; call once per callback
+    void update(float headroom){
+        if(mCount < mHold){ ++mCount; }
+        int t = mTier.load();
+        if(headroom < mDown && t < kNumTiers-1 && mCount >= mHold){
+            mTier.store(t+1); mCount = 0;
+        }
+        // Going back up needs the full hold time of good headroom
+        else if(headroom > mUp && t > 0 && mCount >= mHold){
+            mTier.store(t-1); mCount = 0;
+        }
+        else if(headroom <= mUp && headroom >= mDown){
+            // Restart the wait when headroom is only marginal
+            if(t > 0) mCount = 0;
+        }
+    }
+
+    /// Current quality tier; read at note boundaries
+    int tier() const {
+        int f = mForce.load();
+        return f >= 0 ? f : mTier.load();
+    }
+
+private:
+    float mDown = 0.25f;
+    float mUp = 0.5f;
+    unsigned mHold = 32;
+    unsigned mCount = 0;
+    std::atomic<int> mTier{0};
+    std::atomic<int> mForce{-1};
+};
+
+/// The level-of-detail governor shared by all voices of the app
+inline LodGovernor& lod(){
+    static LodGovernor g;
+    return g;
+}
+
+#endif
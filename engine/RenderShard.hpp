@@ -0,0 +1,357 @@
+#ifndef SYNTHTUTORIAL_ENGINE_RENDERSHARD_HPP
+#define SYNTHTUTORIAL_ENGINE_RENDERSHARD_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           RenderShard.hpp
+    Description:    Render a sequence in several local processes and mix
+                    their outputs through shared memory.
+
+    One audio callback renders every voice on one core. Here a coordinator
+    splits the events of a sequence into shards, forks one render process
+    per shard, and mixes what the render processes produce:
+
+      - splitSequence() writes one .synthSequence file per shard, assigning
+        each event by a hash of its voice class (all voices of a class in
+        one process) or of its position in the file (spreads one class
+        over all processes). Lines that are not events go to every shard,
+        and a "-" (trigger off) follows its "+" (trigger on).
+      - RenderShards::launch() creates one shared-memory ring per shard
+        (shm_open) and forks the render processes, which run the given
+        function: render a block of the shard's sub-mix, write() it, and
+        repeat until write() returns false.
+      - RenderShards::mix() adds the next block of every ring into the
+        output. Frames in the rings are numbered by one sample clock that
+        starts at zero in every process, so block t of each shard is the
+        same time span. mix() waits for every shard to have written past
+        the end of the block (the barrier); a shard that has not by the
+        deadline is skipped for that block and counted in late(), and it
+        drops the frames it missed when it catches up.
+
+    A render process may run ahead of the coordinator by the ring capacity,
+    which absorbs its jitter. With real-time output, use a capacity of
+    several audio blocks.
+
+    launch() forks, so call it before the coordinator starts any thread or
+    opens the audio device. Linux (and other POSIX systems with shm_open).
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "RenderShard.hpp needs lock-free 64-bit atomics to share them between processes"
+#endif
+
+namespace shard {
+
+enum Partition { BY_CLASS, BY_EVENT };
+
+inline uint64_t hash(uint64_t x){
+    // splitmix64 finalizer
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t hash(const std::string& s){
+    uint64_t h = 1469598103934665603ull;    // FNV-1a
+    for(unsigned char c : s){ h ^= c; h *= 1099511628211ull; }
+    return h;
+}
+
+/// Shard of an event: its index among the events of the file, its class
+inline unsigned shardOf(unsigned eventIndex, const std::string& className,
+                        unsigned numShards, Partition p)
+{
+    return unsigned((p == BY_CLASS ? hash(className) : hash(uint64_t(eventIndex))) % numShards);
+}
+
+/// Split a sequence file into numShards files named prefix-<k>.synthSequence
+
+/// \returns false if the input cannot be read or an output cannot be
+/// written
+inline bool splitSequence(const std::string& path, unsigned numShards, Partition p,
+                          const std::string& prefix)
+{
+    std::ifstream in(path);
+    if(!in) return false;
+    std::vector<std::ofstream> out(numShards);
+    for(unsigned k=0; k<numShards; ++k){
+        out[k].open(prefix + "-" + std::to_string(k) + ".synthSequence");
+        if(!out[k]) return false;
+    }
+    std::unordered_map<std::string, unsigned> idShard;     // "+" id -> shard
+    unsigned eventIndex = 0;
+    std::string line;
+    while(std::getline(in, line)){
+        std::istringstream fields(line);
+        std::string cmd, time, id, className;
+        fields >> cmd;
+        int to = -1;                                        // -1: all shards
+        if(cmd == "@"){
+            std::string dur;
+            fields >> time >> dur >> className;
+            to = shardOf(eventIndex++, className, numShards, p);
+        }
+        else if(cmd == "+"){
+            fields >> time >> id >> className;
+            to = shardOf(eventIndex++, className, numShards, p);
+            idShard[id] = to;
+        }
+        else if(cmd == "-"){
+            fields >> time >> id;
+            auto it = idShard.find(id);
+            if(it != idShard.end()) to = it->second;
+        }
+        for(unsigned k=0; k<numShards; ++k){
+            if(to < 0 || unsigned(to) == k) out[k] << line << "\n";
+        }
+    }
+    bool ok = true;
+    for(auto& o : out){ o.close(); ok &= !o.fail(); }
+    return ok;
+}
+
+} // shard::
+
+
+/// One shard's sub-mix in shared memory: a ring of frames written by the
+/// render process and read by the coordinator
+class ShardRing {
+public:
+
+    /// Create and map a new segment (coordinator)
+    bool create(const std::string& name, unsigned channels, unsigned capacity){
+        unsigned size = 1;
+        while(size < capacity) size <<= 1;
+        mName = name;
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0) return false;
+        mBytes = sizeof(Header) + sizeof(float) * size_t(channels) * size;
+        bool ok = ftruncate(fd, off_t(mBytes)) == 0 && map(fd);
+        ::close(fd);
+        if(!ok) return false;
+        mHeader = new (mMem) Header();
+        mHeader->channels = channels;
+        mHeader->capacity = size;
+        mOwner = true;
+        return true;
+    }
+
+    /// Unmap, and remove the segment if this process created it
+    void close(){
+        if(mMem) munmap(mMem, mBytes);
+        if(mOwner) shm_unlink(mName.c_str());
+        mMem = nullptr;
+        mHeader = nullptr;
+        mOwner = false;
+    }
+
+    unsigned channels() const { return mHeader->channels; }
+    unsigned capacity() const { return mHeader->capacity; }
+
+    /// Frames written so far (render process)
+    uint64_t written() const { return mHeader->written.load(std::memory_order_acquire); }
+
+    /// Append n frames of every channel; waits while the ring is full
+
+    /// Frames the coordinator skipped while this process was late are
+    /// dropped. \returns false once the coordinator stops the shard
+    bool write(const float * const * in, unsigned n){
+        Header& h = *mHeader;
+        const unsigned mask = h.capacity - 1;
+        for(unsigned done = 0; done < n; ){
+            if(h.stop.load(std::memory_order_acquire)) return false;
+            uint64_t w = h.written.load(std::memory_order_relaxed);
+            uint64_t r = h.read.load(std::memory_order_acquire);
+            if(w < r){
+                // Late: what we are writing was already mixed without us
+                unsigned skip = unsigned(std::min<uint64_t>(r - w, n - done));
+                done += skip;
+                h.written.store(w + skip, std::memory_order_release);
+                continue;
+            }
+            unsigned space = unsigned(h.capacity - (w - r));
+            if(space == 0){
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            unsigned k = std::min(space, n - done);
+            for(unsigned c=0; c<h.channels; ++c){
+                float * ring = channel(c);
+                for(unsigned i=0; i<k; ++i) ring[(w + i) & mask] = in[c][done + i];
+            }
+            h.written.store(w + k, std::memory_order_release);
+            done += k;
+        }
+        return true;
+    }
+
+private:
+    friend class RenderShards;
+
+    struct Header {
+        unsigned channels = 0, capacity = 0;
+        std::atomic<uint64_t> written {0};  // sample clock of the render process
+        std::atomic<uint64_t> read {0};     // sample clock of the coordinator
+        std::atomic<bool> stop {false};
+    };
+
+    std::string mName;
+    void * mMem = nullptr;
+    size_t mBytes = 0;
+    Header * mHeader = nullptr;
+    bool mOwner = false;
+
+    bool map(int fd){
+        void * m = mmap(nullptr, mBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(m == MAP_FAILED) return false;
+        mMem = m;
+        return true;
+    }
+
+    float * channel(unsigned c){
+        return reinterpret_cast<float *>(static_cast<char *>(mMem) + sizeof(Header))
+             + size_t(c) * mHeader->capacity;
+    }
+};
+
+
+/// Coordinator of the render processes
+class RenderShards {
+public:
+
+    ~RenderShards(){ stop(); }
+
+    /// Create the rings and fork one render process per shard
+
+    /// @param[in] name         prefix of the shared-memory names
+    /// @param[in] numShards    render processes
+    /// @param[in] channels     channels of each sub-mix
+    /// @param[in] capacity     frames a render process may run ahead
+    /// @param[in] render       void(unsigned shard, ShardRing&), run in the
+    ///                         render process, which then exits
+    template <class F>
+    bool launch(const std::string& name, unsigned numShards, unsigned channels,
+                unsigned capacity, F render)
+    {
+        mRings.resize(numShards);
+        for(unsigned k=0; k<numShards; ++k){
+            std::string n = name + "-" + std::to_string(getpid()) + "-" + std::to_string(k);
+            if(!mRings[k].create(n, channels, capacity)){
+                std::printf("RenderShards: could not create %s\n", n.c_str());
+                stop();
+                return false;
+            }
+        }
+        std::fflush(stdout);
+        for(unsigned k=0; k<numShards; ++k){
+            pid_t pid = fork();
+            if(pid == 0){
+                // Render process: keep only our own ring
+                for(unsigned j=0; j<numShards; ++j){
+                    mRings[j].mOwner = false;
+                    if(j != k) mRings[j].close();
+                }
+                render(k, mRings[k]);
+                mRings[k].close();
+                std::fflush(stdout);
+                _exit(0);
+            }
+            if(pid < 0){
+                std::printf("RenderShards: fork failed\n");
+                stop();
+                return false;
+            }
+            mPids.push_back(pid);
+        }
+        return true;
+    }
+
+    unsigned numShards() const { return mRings.size(); }
+
+    /// Blocks in which some shard had not written in time
+    unsigned late() const { return mLate.load(); }
+
+    /// Add the next n frames of every shard into out[0..channels)
+
+    /// @param[in] timeout  longest wait for the barrier; negative waits
+    ///                     as long as needed (offline rendering)
+    void mix(float * const * out, unsigned channels, unsigned n, double timeout){
+        using clock = std::chrono::steady_clock;
+        const uint64_t begin = mTime, end = mTime + n;
+        const auto deadline = clock::now() + std::chrono::duration<double>(timeout);
+        bool wasLate = false;
+        for(auto& ring : mRings){
+            ShardRing::Header& h = *ring.mHeader;
+            // The barrier: wait until this shard has rendered past end
+            while(h.written.load(std::memory_order_acquire) < end){
+                if(timeout >= 0 && clock::now() >= deadline) break;
+                if(timeout < 0) std::this_thread::sleep_for(std::chrono::microseconds(50));
+                else std::this_thread::yield();
+            }
+            uint64_t written = h.written.load(std::memory_order_acquire);
+            uint64_t ready = std::min(written, end);
+            if(ready < end) wasLate = true;
+            const unsigned mask = h.capacity - 1;
+            for(unsigned c=0; c<channels && c<h.channels; ++c){
+                const float * ringData = ring.channel(c);
+                for(uint64_t t=begin; t<ready; ++t) out[c][t - begin] += ringData[t & mask];
+            }
+            h.read.store(end, std::memory_order_release);
+        }
+        if(wasLate) mLate.fetch_add(1, std::memory_order_relaxed);
+        mTime = end;
+    }
+
+    /// Mix into the outputs of io; waits at most a quarter of the block
+    template <class AudioIOData>
+    void mix(AudioIOData& io){
+        float * out[64];
+        unsigned channels = std::min(unsigned(io.channelsOut()), 64u);
+        for(unsigned c=0; c<channels; ++c) out[c] = io.outBuffer(c);
+        mix(out, channels, io.framesPerBuffer(),
+            0.25 * io.framesPerBuffer() / io.framesPerSecond());
+    }
+
+    /// Stop the render processes and remove the rings
+    void stop(){
+        for(auto& ring : mRings){
+            if(ring.mHeader) ring.mHeader->stop.store(true, std::memory_order_release);
+        }
+        for(pid_t pid : mPids){
+            int status;
+            waitpid(pid, &status, 0);
+        }
+        mPids.clear();
+        for(auto& ring : mRings) ring.close();
+        mRings.clear();
+    }
+
+private:
+    std::vector<ShardRing> mRings;
+    std::vector<pid_t> mPids;
+    uint64_t mTime = 0;
+    std::atomic<unsigned> mLate {0};
+};
+
+#endif
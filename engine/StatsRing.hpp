@@ -0,0 +1,82 @@
+#ifndef SYNTHTUTORIAL_ENGINE_STATSRING_HPP
+#define SYNTHTUTORIAL_ENGINE_STATSRING_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           StatsRing.hpp
+    Description:    Lock-free ring for passing statistics out of the audio
+                    thread.
+
+    The audio thread (and any thread triggering voices) push() records; the
+    GUI thread pop()s them for display or logging. push() never blocks or
+    allocates and drops the record when the ring is full. This is a bounded
+    multi-producer multi-consumer queue with a sequence number per slot.
+*/
+
+#include <atomic>
+#include <cstddef>
+
+template <class T, unsigned N=256>
+class StatsRing {
+    static_assert((N & (N-1)) == 0, "StatsRing size must be a power of two");
+public:
+
+    StatsRing(){
+        for(unsigned i=0; i<N; ++i) mSlots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /// Add a record; returns false (and drops it) if the ring is full
+    bool push(const T& v){
+        size_t pos = mHead.load(std::memory_order_relaxed);
+        for(;;){
+            Slot& s = mSlots[pos & (N-1)];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            long dif = long(seq) - long(pos);
+            if(dif == 0){
+                if(mHead.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)){
+                    s.value = v;
+                    s.seq.store(pos+1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(dif < 0){
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else pos = mHead.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Take the oldest record; returns false if the ring is empty
+    bool pop(T& v){
+        size_t pos = mTail.load(std::memory_order_relaxed);
+        for(;;){
+            Slot& s = mSlots[pos & (N-1)];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            long dif = long(seq) - long(pos+1);
+            if(dif == 0){
+                if(mTail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)){
+                    v = s.value;
+                    s.seq.store(pos+N, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(dif < 0) return false;
+            else pos = mTail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Number of records dropped because the ring was full
+    unsigned dropped() const { return mDropped.load(); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    Slot mSlots[N];
+    std::atomic<size_t> mHead{0}, mTail{0};
+    std::atomic<unsigned> mDropped{0};
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef SYNTHTUTORIAL_ENGINE_SYNTHVOICEBANK_HPP
+#define SYNTHTUTORIAL_ENGINE_SYNTHVOICEBANK_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           SynthVoiceBank.hpp
+    Description:    Render voices of one class in lockstep, several per
+                    SIMD vector.
+
+    Every SynthVoice renders on its own, so SIMD can only run across the
+    samples of one voice. A SynthVoiceBank packs voices of the same class
+    into groups of Lanes and renders each group in one loop over the lanes,
+    which the compiler turns into vector instructions. Lanes of a group
+    share nothing but the loop: each has its own parameters, envelope and
+    pan gains.
+
+    The class is described by a Kernel<Lanes> holding the state of Lanes
+    voices as arrays (see dsp/SineEnvLanes.hpp):
+
+        struct Params;                                  trigger parameters
+        void start(unsigned lane, const Params&, double spu);
+        void release(unsigned lane, double spu);
+        void process(float * outL, float * outR, unsigned n);
+        bool done(unsigned lane) const;
+
+    process() renders all lanes and adds them into the output; idle lanes
+    are silent. Voices fill the lowest free group first, so a chord of
+    eight notes costs one pass of an eight-lane group instead of eight
+    voices.
+
+    start() and release() may be called from any thread; the audio thread
+    picks them up at the start of the next render(). start() returns a
+    handle tagged with the lane's generation, which changes every time the
+    lane is claimed, so a voice holding a handle to a lane that has since
+    gone to another note sees it as no longer active().
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Gamma/Domain.h"
+
+template <template <unsigned> class Kernel, unsigned Lanes=8>
+class SynthVoiceBank : public gam::DomainObserver {
+public:
+
+    typedef typename Kernel<Lanes>::Params Params;
+
+    /// A started voice, valid until its lane is freed
+    struct Handle {
+        int index = -1;
+        uint32_t generation = 0;
+    };
+
+    /// @param[in] numGroups    number of groups of Lanes voices
+    SynthVoiceBank(unsigned numGroups=16)
+    :   mNumGroups(numGroups), mGroups(numGroups),
+        mParams(numGroups * Lanes),
+        mState(new std::atomic<uint32_t>[numGroups * Lanes])
+    {
+        for(unsigned i=0; i<numGroups*Lanes; ++i) mState[i] = FREE;
+    }
+
+    /// Maximum number of simultaneous voices
+    unsigned size() const { return mNumGroups * Lanes; }
+
+    /// Start a voice
+
+    /// \returns handle of the voice, with index -1 if all lanes are in use
+    Handle start(const Params& p){
+        for(unsigned i=0; i<size(); ++i){
+            uint32_t expect = mState[i].load(std::memory_order_relaxed);
+            if(stateOf(expect) != FREE) continue;
+            uint32_t gen = (generationOf(expect) + 1) & kGenerationMask;
+            if(mState[i].compare_exchange_strong(expect, pack(gen, CLAIMED))){
+                mParams[i] = p;
+                mState[i].store(pack(gen, PENDING), std::memory_order_release);
+                Handle h;
+                h.index = int(i);
+                h.generation = gen;
+                return h;
+            }
+        }
+        return Handle();
+    }
+
+    /// Release a voice; does nothing if its lane was already freed
+    void release(const Handle& h){
+        if(!valid(h)) return;
+        uint32_t expect = pack(h.generation, ACTIVE);
+        if(!mState[h.index].compare_exchange_strong(expect, pack(h.generation, RELEASING))){
+            // Not started yet; release as soon as it starts
+            expect = pack(h.generation, PENDING);
+            mState[h.index].compare_exchange_strong(expect, pack(h.generation, PENDING_RELEASE));
+        }
+    }
+
+    /// Whether a voice is still sounding (or about to)
+    bool active(const Handle& h) const {
+        if(!valid(h)) return false;
+        uint32_t s = mState[h.index].load();
+        return generationOf(s) == h.generation && stateOf(s) != FREE;
+    }
+
+    /// Number of voices currently sounding
+    unsigned numActive() const {
+        unsigned n = 0;
+        for(unsigned i=0; i<size(); ++i) n += stateOf(mState[i].load()) != FREE;
+        return n;
+    }
+
+    /// Number of groups rendered in the last block
+    unsigned numGroupsRendered() const { return mRendered; }
+
+    /// Add all voices into a stereo output buffer
+    void render(float * outL, float * outR, unsigned n){
+        unsigned rendered = 0;
+        for(unsigned g=0; g<mNumGroups; ++g){
+            Kernel<Lanes>& k = mGroups[g];
+            bool any = false;
+            for(unsigned l=0; l<Lanes; ++l){
+                unsigned i = g*Lanes + l;
+                uint32_t word = mState[i].load(std::memory_order_acquire);
+                const uint32_t gen = generationOf(word);
+                switch(stateOf(word)){
+                case PENDING:
+                    k.start(l, mParams[i], spu());
+                    if(!mState[i].compare_exchange_strong(word, pack(gen, ACTIVE))){
+                        // Released while we were starting it
+                        k.release(l, spu());
+                        mState[i].store(pack(gen, RELEASED), std::memory_order_release);
+                    }
+                    any = true; break;
+                case PENDING_RELEASE:
+                    k.start(l, mParams[i], spu());
+                    k.release(l, spu());
+                    mState[i].store(pack(gen, RELEASED), std::memory_order_release);
+                    any = true; break;
+                case RELEASING:
+                    k.release(l, spu());
+                    mState[i].store(pack(gen, RELEASED), std::memory_order_release);
+                    any = true; break;
+                case ACTIVE: case RELEASED:
+                    any = true; break;
+                default:;
+                }
+            }
+            if(!any) continue;
+            k.process(outL, outR, n);
+            ++rendered;
+            for(unsigned l=0; l<Lanes; ++l){
+                unsigned i = g*Lanes + l;
+                uint32_t word = mState[i].load();
+                if(stateOf(word) == RELEASED && k.done(l)){
+                    mState[i].store(pack(generationOf(word), FREE), std::memory_order_release);
+                }
+            }
+        }
+        mRendered = rendered;
+    }
+
+private:
+    // The state word of a lane packs its generation above its state
+    enum { FREE=0, CLAIMED, PENDING, PENDING_RELEASE, ACTIVE, RELEASING, RELEASED };
+    static const unsigned kStateBits = 3;
+    static const uint32_t kGenerationMask = (uint32_t(1) << (32 - kStateBits)) - 1;
+
+    static uint32_t pack(uint32_t generation, int state){ return generation << kStateBits | uint32_t(state); }
+    static int stateOf(uint32_t s){ return int(s & ((1u << kStateBits) - 1)); }
+    static uint32_t generationOf(uint32_t s){ return s >> kStateBits; }
+
+    bool valid(const Handle& h) const { return h.index >= 0 && unsigned(h.index) < size(); }
+
+    unsigned mNumGroups;
+    std::vector<Kernel<Lanes>> mGroups;
+    std::vector<Params> mParams;
+    std::unique_ptr<std::atomic<uint32_t>[]> mState;
+    unsigned mRendered = 0;
+};
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef SYNTHTUTORIAL_ENGINE_VBAP_HPP
+#define SYNTHTUTORIAL_ENGINE_VBAP_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           Vbap.hpp
+    Description:    Pan voices over any number of speakers with vector base
+                    amplitude panning (VBAP).
+
+    A SpeakerLayout lists the output channel and direction of every speaker.
+    It is read from a text file with one speaker per line,
+
+        # channel  azimuth  elevation
+        0           30       0
+        1          -30       0
+        2            0      45
+
+    in degrees: azimuth 0 is straight ahead and positive to the left,
+    elevation is positive upwards and may be left out. Lines starting with
+    # are comments.
+
+    Vbap splits the sphere between neighbouring speakers: adjacent pairs
+    when all speakers are at ear level, otherwise the triangles of the
+    layout's convex hull. A direction is then played by the 2 or 3 speakers
+    of the pair or triangle it falls in, with gains that sum to unit power.
+    Directions outside the layout (below a dome, behind a stereo pair) go
+    to the nearest edge.
+
+    VbapPanner replaces gam::Pan in a voice. The voice collects its mono
+    output for the block, sets the direction once per block (control rate)
+    and renders:
+
+        while(io()){
+            float s = ...;
+            mSpat(s);
+        }
+        mSpat.position(vbap(), azimuth, elevation);
+        mSpat.render(io);
+
+    render() writes only to the speakers in use, at most three, plus the
+    ones being faded out after a move. Each channel is one loop adding the
+    input times a gain ramp, which the compiler vectorizes. Gains glide
+    from the previous block's to the new ones over the block so a moving
+    voice does not click.
+
+    vbap() is the layout shared by all voices. Load it before audio starts.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct Speaker {
+    unsigned channel;
+    float azimuth;      ///< degrees, positive to the left
+    float elevation;    ///< degrees, positive upwards
+};
+
+class SpeakerLayout {
+public:
+
+    /// Two speakers at +/-30 degrees on channels 0 (left) and 1 (right)
+    static SpeakerLayout stereo(){
+        SpeakerLayout l;
+        l.mSpeakers = {{0, 30.f, 0.f}, {1, -30.f, 0.f}};
+        return l;
+    }
+
+    /// Read a layout file; returns false on any error
+    bool load(const std::string& path){
+        FILE * f = std::fopen(path.c_str(), "r");
+        if(!f) return false;
+        std::vector<Speaker> speakers;
+        char line[256];
+        unsigned lineNum = 0;
+        bool ok = true;
+        while(ok && std::fgets(line, sizeof(line), f)){
+            ++lineNum;
+            const char * p = line;
+            while(*p == ' ' || *p == '\t') ++p;
+            if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+            Speaker s {0, 0.f, 0.f};
+            ok = std::sscanf(p, "%u %f %f", &s.channel, &s.azimuth, &s.elevation) >= 2;
+            if(ok) speakers.push_back(s);
+        }
+        std::fclose(f);
+        if(!ok || speakers.empty()){
+            std::printf("SpeakerLayout: could not read %s (line %u)\n", path.c_str(), lineNum);
+            return false;
+        }
+        mSpeakers = std::move(speakers);
+        return true;
+    }
+
+    const std::vector<Speaker>& speakers() const { return mSpeakers; }
+    unsigned size() const { return mSpeakers.size(); }
+
+    /// Output channels needed, the highest channel + 1
+    unsigned numChannels() const {
+        unsigned n = 0;
+        for(auto& s : mSpeakers) n = std::max(n, s.channel + 1);
+        return n;
+    }
+
+private:
+    std::vector<Speaker> mSpeakers;
+};
+
+
+/// Speakers and gains for one direction
+struct VbapGains {
+    unsigned count = 0;
+    unsigned channel[3];
+    float gain[3];
+};
+
+
+class Vbap {
+public:
+
+    Vbap(){ layout(SpeakerLayout::stereo()); }
+
+    /// Set the layout and split it into pairs or triangles
+    void layout(const SpeakerLayout& l){
+        mLayout = l;
+        mSets.clear();
+        const std::vector<Speaker>& sp = l.speakers();
+        mDirs.resize(sp.size());
+        bool flat = true;
+        for(unsigned i=0; i<sp.size(); ++i){
+            direction(sp[i].azimuth, sp[i].elevation, mDirs[i].v);
+            flat &= std::fabs(sp[i].elevation) < 0.5f;
+        }
+        if(sp.size() < 2) return;
+        if(flat || sp.size() < 3) makePairs();
+        else makeTriangles();
+        if(mSets.empty()) makePairs();  // speakers all in one plane
+        mFront = 0.f;
+        for(auto& s : sp){
+            float a = std::fabs(s.azimuth);
+            if(a <= 90.f) mFront = std::max(mFront, a);
+        }
+        if(mFront == 0.f) mFront = 90.f;
+    }
+
+    /// Load a layout file, keeping the current layout on failure
+    bool load(const std::string& path){
+        SpeakerLayout l;
+        if(!l.load(path)) return false;
+        layout(l);
+        return true;
+    }
+
+    const SpeakerLayout& layout() const { return mLayout; }
+    unsigned numChannels() const { return mLayout.numChannels(); }
+
+    /// Widest speaker azimuth in the front half, in degrees
+
+    /// Maps a stereo pan position: pan -1..1 is azimuth front()..-front(),
+    /// so on a stereo pair the ends of the range are the two speakers.
+    float front() const { return mFront; }
+
+    /// Azimuth in degrees of a pan position in -1 (left) to 1 (right)
+    float azimuthOfPan(float pan) const { return -pan * mFront; }
+
+    /// Gains for a direction in degrees
+    VbapGains gains(float azimuth, float elevation=0.f) const {
+        VbapGains g;
+        const std::vector<Speaker>& sp = mLayout.speakers();
+        if(sp.size() == 1 || mSets.empty()){
+            if(!sp.empty()){ g.count = 1; g.channel[0] = sp[0].channel; g.gain[0] = 1.f; }
+            return g;
+        }
+        float p[3];
+        direction(azimuth, elevation, p);
+
+        // The set the direction falls in has no negative gain. Outside all
+        // sets, take the one whose gains, with negatives set to zero, point
+        // closest to the direction.
+        int best = 0;
+        float bestScore = -3.f, bestGain[3] = {0, 0, 0};
+        for(unsigned s=0; s<mSets.size(); ++s){
+            const Set& set = mSets[s];
+            float w[3], lowest = 1e30f;
+            for(unsigned k=0; k<set.count; ++k){
+                w[k] = set.inv[k][0]*p[0] + set.inv[k][1]*p[1] + set.inv[k][2]*p[2];
+                lowest = std::min(lowest, w[k]);
+            }
+            if(lowest >= -1e-5f){
+                best = s;
+                std::copy(w, w + set.count, bestGain);
+                break;
+            }
+            float v[3] = {0, 0, 0};
+            for(unsigned k=0; k<set.count; ++k){
+                w[k] = std::max(w[k], 0.f);
+                for(unsigned c=0; c<3; ++c) v[c] += w[k] * mDirs[set.speaker[k]].v[c];
+            }
+            float len = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+            float score = len > 0.f ? (v[0]*p[0] + v[1]*p[1] + v[2]*p[2]) / len : -2.f;
+            if(score > bestScore){
+                bestScore = score;
+                best = s;
+                std::copy(w, w + set.count, bestGain);
+            }
+        }
+        const Set& set = mSets[best];
+        float power = 0.f;
+        for(unsigned k=0; k<set.count; ++k){
+            bestGain[k] = std::max(bestGain[k], 0.f);
+            power += bestGain[k] * bestGain[k];
+        }
+        // Directly opposite a pair: the speaker nearest to the direction
+        if(power == 0.f){
+            float nearest = -2.f;
+            for(unsigned k=0; k<set.count; ++k){
+                const float * d = mDirs[set.speaker[k]].v;
+                float dot = d[0]*p[0] + d[1]*p[1] + d[2]*p[2];
+                if(dot > nearest){ nearest = dot; std::fill(bestGain, bestGain + 3, 0.f); bestGain[k] = 1.f; }
+            }
+            power = 1.f;
+        }
+        float norm = power > 0.f ? 1.f / std::sqrt(power) : 0.f;
+        for(unsigned k=0; k<set.count; ++k){
+            if(bestGain[k] * norm < 1e-4f) continue;
+            g.channel[g.count] = sp[set.speaker[k]].channel;
+            g.gain[g.count] = bestGain[k] * norm;
+            ++g.count;
+        }
+        return g;
+    }
+
+private:
+    struct Dir { float v[3]; };
+
+    // A pair or triangle of speakers and the inverse of their directions
+    struct Set {
+        unsigned count;
+        unsigned speaker[3];
+        float inv[3][3];
+    };
+
+    SpeakerLayout mLayout;
+    std::vector<Dir> mDirs;
+    std::vector<Set> mSets;
+    float mFront = 30.f;
+
+    static void direction(float azimuth, float elevation, float * v){
+        const float rad = 3.14159265f / 180.f;
+        float a = azimuth * rad, e = elevation * rad;
+        v[0] = std::cos(e) * std::cos(a);     // front
+        v[1] = std::cos(e) * std::sin(a);     // left
+        v[2] = std::sin(e);                   // up
+    }
+
+    // Neighbours around the horizontal circle, less than 180 degrees apart
+    void makePairs(){
+        const std::vector<Speaker>& sp = mLayout.speakers();
+        std::vector<unsigned> order(sp.size());
+        for(unsigned i=0; i<order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(),
+            [&](unsigned a, unsigned b){ return sp[a].azimuth < sp[b].azimuth; });
+        for(unsigned k=0; k<order.size(); ++k){
+            unsigned i = order[k], j = order[(k+1) % order.size()];
+            if(i == j) continue;
+            float arc = sp[j].azimuth - sp[i].azimuth;
+            if(arc <= 0.f) arc += 360.f;
+            if(arc >= 179.f) continue;
+            // 2x2 inverse in the horizontal plane
+            const float * a = mDirs[i].v;
+            const float * b = mDirs[j].v;
+            float det = a[0]*b[1] - a[1]*b[0];
+            if(std::fabs(det) < 1e-6f) continue;
+            Set s {2, {i, j, 0}, {{0}}};
+            s.inv[0][0] =  b[1] / det; s.inv[0][1] = -b[0] / det;
+            s.inv[1][0] = -a[1] / det; s.inv[1][1] =  a[0] / det;
+            mSets.push_back(s);
+        }
+    }
+
+    // Faces of the convex hull: triangles with every other speaker on the
+    // same side. Faces through the center (e.g. the ring of a dome seen
+    // from below) cannot pan and are left out.
+    void makeTriangles(){
+        const unsigned n = mDirs.size();
+        for(unsigned i=0; i<n; ++i)
+        for(unsigned j=i+1; j<n; ++j)
+        for(unsigned k=j+1; k<n; ++k){
+            const float * a = mDirs[i].v;
+            const float * b = mDirs[j].v;
+            const float * c = mDirs[k].v;
+            float u[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+            float w[3] = {c[0]-a[0], c[1]-a[1], c[2]-a[2]};
+            float nrm[3] = {u[1]*w[2] - u[2]*w[1], u[2]*w[0] - u[0]*w[2], u[0]*w[1] - u[1]*w[0]};
+            float len = std::sqrt(nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2]);
+            if(len < 1e-6f) continue;
+            float d = (nrm[0]*a[0] + nrm[1]*a[1] + nrm[2]*a[2]) / len;
+            bool above = false, below = false;
+            for(unsigned m=0; m<n; ++m){
+                if(m == i || m == j || m == k) continue;
+                const float * q = mDirs[m].v;
+                float side = (nrm[0]*q[0] + nrm[1]*q[1] + nrm[2]*q[2]) / len - d;
+                above |= side > 1e-4f;
+                below |= side < -1e-4f;
+            }
+            if(above && below) continue;
+            if(std::fabs(d) < 1e-3f) continue;
+            Set s {3, {i, j, k}, {{0}}};
+            if(invert(a, b, c, s.inv)) mSets.push_back(s);
+        }
+    }
+
+    // Rows of the inverse of the matrix with columns a, b, c
+    static bool invert(const float * a, const float * b, const float * c, float inv[3][3]){
+        float det = a[0]*(b[1]*c[2] - b[2]*c[1])
+                  - b[0]*(a[1]*c[2] - a[2]*c[1])
+                  + c[0]*(a[1]*b[2] - a[2]*b[1]);
+        if(std::fabs(det) < 1e-6f) return false;
+        // Row k is the cross product of the other two columns over det
+        const float * col[3] = {a, b, c};
+        for(unsigned k=0; k<3; ++k){
+            const float * x = col[(k+1) % 3];
+            const float * y = col[(k+2) % 3];
+            inv[k][0] = (x[1]*y[2] - x[2]*y[1]) / det;
+            inv[k][1] = (x[2]*y[0] - x[0]*y[2]) / det;
+            inv[k][2] = (x[0]*y[1] - x[1]*y[0]) / det;
+        }
+        return true;
+    }
+};
+
+/// The speaker layout shared by all voices of the app
+inline Vbap& vbap(){
+    static Vbap v;
+    return v;
+}
+
+
+/// Per-voice VBAP output stage
+class VbapPanner {
+public:
+
+    static const unsigned kMaxBlock = 8192;
+
+    /// Add next input sample to the block
+    void operator()(float s){
+        if(mFill < kMaxBlock) mIn[mFill++] = s;
+    }
+
+    /// Set the direction in degrees for the block being rendered
+    void position(const Vbap& v, float azimuth, float elevation=0.f){
+        mTarget = v.gains(azimuth, elevation);
+    }
+
+    /// Start the next block at the target gains instead of gliding;
+    /// call when the voice is triggered
+    void reset(){ mJump = true; }
+
+    /// Add the collected block to the speakers of the current direction
+
+    /// The samples collected are the last ones of the block, as written by
+    /// an io() loop that may have started at an offset.
+    template <class AudioIOData>
+    void render(AudioIOData& io){
+        const unsigned n = mFill;
+        const unsigned frames = io.framesPerBuffer();
+        const unsigned offset = frames > n ? frames - n : 0;
+        const unsigned channels = io.channelsOut();
+        mFill = 0;
+        if(mJump){ mCurrent = mTarget; mJump = false; }
+
+        // Channels of the new gains, then old channels fading out
+        for(unsigned k=0; k<mTarget.count; ++k){
+            float from = 0.f;
+            for(unsigned j=0; j<mCurrent.count; ++j){
+                if(mCurrent.channel[j] == mTarget.channel[k]) from = mCurrent.gain[j];
+            }
+            if(mTarget.channel[k] < channels){
+                addRamp(io.outBuffer(mTarget.channel[k]) + offset, n, from, mTarget.gain[k]);
+            }
+        }
+        for(unsigned j=0; j<mCurrent.count; ++j){
+            bool kept = false;
+            for(unsigned k=0; k<mTarget.count; ++k) kept |= mCurrent.channel[j] == mTarget.channel[k];
+            if(!kept && mCurrent.channel[j] < channels){
+                addRamp(io.outBuffer(mCurrent.channel[j]) + offset, n, mCurrent.gain[j], 0.f);
+            }
+        }
+        mCurrent = mTarget;
+    }
+
+private:
+    float mIn[kMaxBlock];
+    unsigned mFill = 0;
+    VbapGains mCurrent, mTarget;
+    bool mJump = true;
+
+    void addRamp(float * out, unsigned n, float from, float to){
+        const float * in = mIn;
+        if(from == to){
+            for(unsigned i=0; i<n; ++i) out[i] += in[i] * to;
+            return;
+        }
+        const float step = n ? (to - from) / n : 0.f;
+        for(unsigned i=0; i<n; ++i) out[i] += in[i] * (from + step * (i+1));
+    }
+};
+
+#endif
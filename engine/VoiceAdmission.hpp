@@ -0,0 +1,258 @@
+#ifndef SYNTHTUTORIAL_ENGINE_VOICEADMISSION_HPP
+#define SYNTHTUTORIAL_ENGINE_VOICEADMISSION_HPP
+
+/*    Synthesis tutorial - engine utilities
+
+    File:           VoiceAdmission.hpp
+    Description:    Admit new voices only while the audio callback can
+                    afford them.
+
+    VoiceAdmission measures how long the audio callback takes compared to
+    its period (the load), and how long one block of each voice class
+    takes. When a voice is triggered, the load it would add is predicted
+    from its class cost:
+
+    - it fits the budget               ADMIT
+    - a releasing voice can make room  STEAL (the releasing voice yields)
+    - otherwise, for up to maxDelay()  DELAY (retry on the next block)
+    - after that                       REJECT
+
+    Every decision other than a plain ADMIT is pushed to a StatsRing that
+    the GUI thread can drain. Voices take part through an AdmissionTicket
+    member; see synth7add.cpp.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#include "StatsRing.hpp"
+
+class VoiceAdmission {
+public:
+
+    enum Decision { ADMIT=0, STEAL, DELAY, REJECT };
+
+    static const int kMaxClasses = 16;
+
+    struct Event {
+        int voiceClass;
+        Decision decision;
+        float load;         ///< measured callback load when deciding
+        float predicted;    ///< predicted load with the new voice
+    };
+
+    static const char * decisionName(Decision d){
+        switch(d){
+        case ADMIT:  return "admit";
+        case STEAL:  return "steal";
+        case DELAY:  return "delay";
+        default:     return "reject";
+        }
+    }
+
+    /// Register a voice class by name and get its id
+
+    /// Registering the same name again returns the existing id.
+    /// @param[in] name         class name, must outlive the controller
+    /// @param[in] initialCost  cost guess in seconds per block until measured
+    int voiceClass(const char * name, float initialCost=20e-6f){
+        std::lock_guard<std::mutex> lock(mRegister);
+        for(int i=0; i<mNumClasses; ++i){
+            if(0 == std::strcmp(mClasses[i].name, name)) return i;
+        }
+        if(mNumClasses == kMaxClasses) return kMaxClasses - 1;
+        Class& c = mClasses[mNumClasses];
+        c.name = name;
+        c.cost = initialCost;
+        return mNumClasses++;
+    }
+
+    const char * className(int cls) const { return mClasses[cls].name; }
+
+    /// Set the fraction of the callback period voices may use
+    void budget(float fraction){ mBudget.store(fraction, std::memory_order_relaxed); }
+    float budget() const { return mBudget.load(std::memory_order_relaxed); }
+
+    /// Set how many blocks a voice may wait before it is rejected
+    void maxDelay(unsigned blocks){ mMaxDelay = blocks; }
+    unsigned maxDelay() const { return mMaxDelay; }
+
+    /// Call at the start of the audio callback
+    void beginCallback(){ mCallbackStart = Clock::now(); }
+
+    /// Call at the end of the audio callback
+    void endCallback(unsigned frames, double framesPerSecond){
+        float period = float(frames / framesPerSecond);
+        float load = seconds(mCallbackStart) / period;
+        // Rise fast, fall slowly
+        float l = mLoad.load();
+        l = load > l ? load : l + 0.05f * (load - l);
+        mLoad.store(l);
+        mPeriod.store(period);
+        // Voices admitted from now on are not in this measurement yet
+        mPending.exchange(0.f);
+        // Releasing voices have all had a chance to yield by now
+        mSteals.store(0);
+    }
+
+    /// Smoothed callback load, 1 being the whole period
+    float load() const { return mLoad.load(); }
+
+    /// Fraction of the callback period still free
+    float headroom() const { return 1.f - mLoad.load(); }
+
+    /// Measured cost of one block of a voice class in seconds
+    float cost(int cls) const { return mClasses[cls].cost.load(); }
+
+    /// Report the time one voice of a class took for one block
+    void addCost(int cls, float seconds){
+        float c = mClasses[cls].cost.load();
+        mClasses[cls].cost.store(c + 0.02f * (seconds - c));
+    }
+
+    /// Decide whether a voice may start
+    Decision request(int cls, unsigned waited){
+        float period = mPeriod.load();
+        float add = cost(cls) / period;
+        float load = mLoad.load();
+        float predicted = load + mPending.load() + add;
+        Decision d;
+        if(predicted <= mBudget.load(std::memory_order_relaxed)){
+            d = ADMIT;
+        }
+        else if(mSteals.load() < mReleasing.load()){
+            mSteals.fetch_add(1);
+            d = STEAL;
+        }
+        else if(waited < mMaxDelay){
+            d = DELAY;
+        }
+        else {
+            d = REJECT;
+        }
+        if(d == ADMIT || d == STEAL){
+            // Count the voice until the next measurement includes it. The
+            // GUI and audio threads both request voices, so add atomically
+            // (atomic<float> has no fetch_add before C++20)
+            float p = mPending.load();
+            while(!mPending.compare_exchange_weak(p, p + add)){}
+        }
+        if(d != ADMIT || waited) mEvents.push(Event{cls, d, load, predicted});
+        return d;
+    }
+
+    /// A voice entered its release
+    void released(){ mReleasing.fetch_add(1); }
+
+    /// A voice stopped; pass whether it was releasing
+    void finished(bool wasReleasing){ if(wasReleasing) mReleasing.fetch_sub(1); }
+
+    /// Called by releasing voices; true if this one should make room
+    bool claimSteal(){
+        int s = mSteals.load();
+        while(s > 0){
+            if(mSteals.compare_exchange_weak(s, s-1)) return true;
+        }
+        return false;
+    }
+
+    /// Decisions for logging or display
+    StatsRing<Event>& events(){ return mEvents; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Class {
+        const char * name = "";
+        std::atomic<float> cost{0.f};
+    };
+
+    static float seconds(Clock::time_point since){
+        return std::chrono::duration<float>(Clock::now() - since).count();
+    }
+
+    Class mClasses[kMaxClasses];
+    int mNumClasses = 0;
+    std::mutex mRegister;
+
+    std::atomic<float> mBudget{0.7f};
+    unsigned mMaxDelay = 8;
+    Clock::time_point mCallbackStart;
+    std::atomic<float> mLoad{0.f};
+    std::atomic<float> mPeriod{256.f/48000.f};
+    std::atomic<float> mPending{0.f};
+    std::atomic<int> mReleasing{0};
+    std::atomic<int> mSteals{0};
+    StatsRing<Event> mEvents;
+};
+
+/// The admission controller shared by all voices of the app
+inline VoiceAdmission& admission(){
+    static VoiceAdmission a;
+    return a;
+}
+
+
+/// Per-voice view of the admission controller
+class AdmissionTicket {
+public:
+
+    /// Set voice class, from VoiceAdmission::voiceClass()
+    void voiceClass(int id){ mClass = id; }
+
+    /// Ask to start; call from onTriggerOn()
+    void request(){
+        finish();
+        mWaited = 0;
+        mDecision = admission().request(mClass, 0);
+        mActive = true;
+    }
+
+    /// Call at the start of onProcess(); false if the voice must not render
+
+    /// A delayed voice retries here. Its envelopes have not been
+    /// advanced while waiting, so it simply starts late.
+    bool beginBlock(){
+        if(mDecision == VoiceAdmission::DELAY){
+            mDecision = admission().request(mClass, ++mWaited);
+        }
+        mStart = std::chrono::steady_clock::now();
+        return mDecision == VoiceAdmission::ADMIT || mDecision == VoiceAdmission::STEAL;
+    }
+
+    /// Whether the voice was turned away and should free itself
+    bool rejected() const { return mDecision == VoiceAdmission::REJECT; }
+
+    /// Call at the end of onProcess(); true if the voice should yield
+    bool endBlock(){
+        admission().addCost(mClass, std::chrono::duration<float>(
+            std::chrono::steady_clock::now() - mStart).count());
+        return mReleasing && admission().claimSteal();
+    }
+
+    /// Call from onTriggerOff()
+    void release(){
+        if(mActive && !mReleasing){
+            mReleasing = true;
+            admission().released();
+        }
+    }
+
+    /// Call before free()
+    void finish(){
+        if(mActive) admission().finished(mReleasing);
+        mActive = mReleasing = false;
+    }
+
+private:
+    int mClass = 0;
+    VoiceAdmission::Decision mDecision = VoiceAdmission::ADMIT;
+    unsigned mWaited = 0;
+    bool mActive = false;
+    bool mReleasing = false;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*    Gamma - Generic processing library
+    See COPYRIGHT file for authors and license information
+
+    Example:        Filter / Plucked String Bank
+    Description:    Dense plucked textures. The strings are the same
+                    noise-excited feedback delay-lines as in pl-pan.cpp, but
+                    all of them are rendered together by a PluckedStringBank.
+*/
+
+#include <cstdio>               // for printing to stdout
+#define GAMMA_H_INC_ALL         // define this to include all header files
+#define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
+
+#include "Gamma/Gamma.h"
+#include "Gamma/Types.h"
+
+#include "al/core/app/al_App.hpp"
+#include "al/core/graphics/al_Shapes.hpp"
+#include "al/util/ui/al_Parameter.hpp"
+#include "al/util/scene/al_PolySynth.hpp"
+#include "al/util/scene/al_SynthSequencer.hpp"
+#include "al/util/ui/al_ControlGUI.hpp"
+
+#include "dsp/PluckedStringBank.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+
+using namespace al;
+
+// All strings live here. The voices below only start and release them.
+PluckedStringBank stringBank {256};
+
+// The voice is a handle to one string of the bank, so plucks can still be
+// played from the keyboard, recorded and sequenced like any other voice.
+class PluckBank : public SynthVoice {
+public:
+    PluckedStringBank::Handle mString;
+
+    virtual void init(){
+        createInternalTriggerParameter("amplitude", 0.1, 0.0, 1.0);
+        createInternalTriggerParameter("frequency", 60, 20, 5000);
+        createInternalTriggerParameter("decay", 0.1, 0.001, 1.0);
+        createInternalTriggerParameter("releaseTime", 3.0, 0.1, 10.0);
+        createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+    }
+
+    virtual void onProcess(AudioIOData& io) override {
+        // Audio is rendered by stringBank in MyApp::onSound()
+        if(!stringBank.active(mString)) free();
+    }
+
+    virtual void onTriggerOn() override {
+        mString = stringBank.pluck(getInternalParameterValue("frequency"),
+                                   getInternalParameterValue("amplitude"),
+                                   getInternalParameterValue("pan"),
+                                   getInternalParameterValue("decay"),
+                                   getInternalParameterValue("releaseTime"));
+    }
+
+    virtual void onTriggerOff() override {
+        stringBank.release(mString);
+    }
+};
+
+class MyApp : public App
+{
+public:
+    virtual void onCreate() override {
+        ParameterGUI::initialize();
+        synthManager.synthRecorder().verbose(true);
+    }
+
+    virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        synthManager.render(io); // Start and release strings
+        stringBank.render(io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+    }
+
+    virtual void onDraw(Graphics &g) override {
+        g.clear();
+        synthManager.render(g);
+
+        // Draw GUI
+        ParameterGUI::beginDraw();
+        ParameterGUI::beginPanel(synthManager.name());
+        if (ImGui::Button("Texture")) {
+            fillTexture(0, 4, 200);
+        }
+        ImGui::SameLine();
+        ImGui::Text("%u strings", stringBank.numActive());
+        ImGui::Separator();
+        synthManager.drawSynthWidgets();
+        ParameterGUI::endPanel();
+        ParameterGUI::endDraw();
+    }
+
+    virtual void onKeyDown(Keyboard const& k) override {
+      if (ParameterGUI::usingKeyboard()) { //Ignore keys if GUI is using them
+        return;
+      }
+        if (k.shift()) {
+            // If shift pressed then keyboard sets preset
+            int presetNumber = asciiToIndex(k.key());
+            synthManager.recallPreset(presetNumber);
+        } else {
+            // Otherwise trigger note for polyphonic synth
+            int midiNote = asciiToMIDI(k.key());
+            if(k.ctrl()) {
+              midiNote -= 24;
+            }
+            if (midiNote > 0) {
+              synthManager.voice()->setInternalParameterValue("frequency", ::pow(2.f, (midiNote - 69.f)/12.f) * 432.f);
+              synthManager.triggerOn(midiNote);
+            }
+        }
+    }
+
+    virtual void onKeyUp(Keyboard const& k) override {
+        int midiNote = asciiToMIDI(k.key());
+        if (midiNote > 0) {
+            synthManager.triggerOff(midiNote);
+            synthManager.triggerOff(midiNote -24); // Trigger both off for safety
+        }
+    }
+
+    void onExit() override {
+        ParameterGUI::cleanup();
+    }
+
+    // Scatter count plucks at random pitches and positions between from and to
+    void fillTexture(float from, float to, int count) {
+        for (int i = 0; i < count; i++) {
+            auto *voice = synthManager.synth().getVoice<PluckBank>();
+            voice->setInternalParameterValue("amplitude", 0.02);
+            voice->setInternalParameterValue("frequency", deterministic().random().uni(80.f, 1200.f));
+            voice->setInternalParameterValue("decay", deterministic().random().uni(0.005f, 0.1f));
+            voice->setInternalParameterValue("releaseTime", 2.0);
+            voice->setInternalParameterValue("pan", deterministic().random().uni(-1.f, 1.f));
+            synthManager.synthSequencer().addVoiceFromNow(voice, deterministic().random().uni(from, to), 2.0);
+        }
+    }
+
+    SynthGUIManager<PluckBank> synthManager {"pluckbank"};
+};
+
+
+int main(){
+    MyApp app;
+    app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
+    // Set up audio
+    app.initAudio(48000., 256, 2, 0);
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(app.audioIO().framesPerSecond());
+    app.audioIO().print();
+
+    app.start();
+    return 0;
+}
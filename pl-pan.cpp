@@ -20,20 +20,33 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/BlockNoise.hpp"
+#include "dsp/ConvolutionReverb.hpp"
+#include "dsp/DelayArena.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+
 using namespace al;
 
+// Delay memory for all strings, reserved in MyApp::onCreate()
+DelayArena delayArena;
+
+// Room for the whole mix, loaded in MyApp::onCreate()
+ConvolutionReverb reverb;
+
 class PluckedString : public SynthVoice {
 public:
     float mAmp;
     float mDur;
     float mPanRise;
     gam::Pan<> mPan;
-    gam::NoiseWhite<> noise;
+    BlockNoise noise;
     gam::Decay<> env;
     gam::MovingAvg<> fil {2};
-    gam::Delay<float, gam::ipl::Trunc> delay;
+    ArenaDelay delay;   // leased from delayArena while the voice is active
     gam::ADSR<> mAmpEnv;
-    gam::EnvFollow<> mEnvFollow;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
     gam::Env<2> mPanEnv;
 
     // Additional members
@@ -46,8 +59,6 @@ public:
         mAmpEnv.levels(1,1,0);
         mPanEnv.curve(4);
         env.decay(0.1);
-        delay.maxDelay(1./27.5);
-        delay.delay(1./440.0);
 
 
         addDisc(mMesh, 1.0, 30);
@@ -68,23 +79,30 @@ public:
         return (*this)(noise()*env());
     }
     float operator() (float in){
+        float y = delay();
+        COUNT_SUBNORMALS("PluckedString", y); // debug builds only, see engine/Denormals.hpp
         return delay(
-                     fil( delay() + in )
+                     fil( y + in )
                      );
     }
 
     virtual void onProcess(AudioIOData& io) override {
+        if(!delay.valid()){ free(); return; } // arena was exhausted
 
         while(io()){
             mPan.pos(mPanEnv());
             float s1 =  (*this)() * mAmpEnv() * mAmp;
             float s2;
-            mEnvFollow(s1);
+            mPeak(s1);
             mPan(s1, s1,s2);
             io.out(0) += s1;
             io.out(1) += s2;
         }
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())){
+            delay.release();
+            free();
+        }
 
     }
 /*
@@ -94,16 +112,24 @@ virtual void onProcess(Graphics &g) {
         g.pushMatrix();
         g.translate(amplitude,  amplitude, -4);
         g.scale(frequency/200, frequency/400, 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
 */
     virtual void onTriggerOn() override {
+        // Lease a line long enough for the lowest note (27.5 Hz).
+        // Leased memory comes back zeroed.
+        if(!delay.valid()){
+            delay.lease(delayArena, unsigned(gam::Domain::master().spu()/27.5) + 1);
+        }
+        else {
+            delay.zero();
+        }
+        if(deterministic().enabled()) noise.seed(deterministic().voiceSeed(id()));
         updateFromParameters();
         mAmpEnv.reset();
         env.reset();
-        delay.zero();
     }
 
     virtual void onTriggerOff() override {
@@ -115,7 +141,7 @@ virtual void onProcess(Graphics &g) {
                        getInternalParameterValue("Pan2"),
                        getInternalParameterValue("Pan1"));
         mPanRise = getInternalParameterValue("PanRise");
-        delay.freq(getInternalParameterValue("frequency"));
+        delay.delay(gam::Domain::master().spu()/getInternalParameterValue("frequency"));
         mAmp = getInternalParameterValue("amplitude");
         mAmpEnv.attack(getInternalParameterValue("attackTime"));
         mAmpEnv.decay(getInternalParameterValue("attackTime"));
@@ -136,13 +162,29 @@ public:
     virtual void onCreate() override {
         ParameterGUI::initialize();
 
+        // Preallocate delay lines for 64 simultaneous strings down to 27.5 Hz
+        delayArena.reserve(unsigned(audioIO().framesPerSecond()/27.5) + 2, 64);
+
+        // Put a recorded impulse response in pluck-data/ir.wav, or get a
+        // synthetic 2.5 s room
+        if (!reverb.load("pluck-data/ir.wav", audioIO().framesPerSecond())) {
+            makeRoom(2.5, audioIO().framesPerSecond());
+        }
+
         // Play example sequence. Comment this line to start from scratch
     //    synthManager.synthSequencer().playSequence("pl-pan.synthSequence");
         synthManager.synthRecorder().verbose(true);
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        // Track mix level for voice retirement on the dry mix; the room
+        // tail must not make the voices look quieter than they are
+        voiceRetirement().observeMix(io);
+        float * L = io.outBuffer(0);
+        float * R = io.outBuffer(1);
+        reverb.process(L, R, L, R, io.framesPerBuffer()); // Send the mix to the room
     }
 
     virtual void onDraw(Graphics &g) override {
@@ -152,6 +194,15 @@ public:
         // Draw GUI
         ParameterGUI::beginDraw();
         ParameterGUI::beginPanel(synthManager.name());
+        float mix = reverb.mix();
+        if (ImGui::SliderFloat("Reverb", &mix, 0.0f, 1.0f)) {
+            reverb.mix(mix);
+        }
+        if (reverb.underruns() > 0) {
+            ImGui::SameLine();
+            ImGui::Text("%u tail underruns", reverb.underruns());
+        }
+        ImGui::Separator();
         synthManager.drawSynthWidgets();
         ParameterGUI::endPanel();
         ParameterGUI::endDraw();
@@ -189,6 +240,24 @@ public:
     void onExit() override {
         ParameterGUI::cleanup();
     }
+
+    // Exponentially decaying noise, a different sequence on each side,
+    // down 60 dB after t60 seconds and scaled to unit energy
+    void makeRoom(float t60, double sampleRate) {
+        unsigned n = unsigned(t60 * sampleRate);
+        std::vector<float> L(n), R(n);
+        float gain = ::sqrt(3.f * 6.f * ::log(10.f) / n);
+        uint32_t seed = 1;
+        for (unsigned i = 0; i < n; i++) {
+            float env = gain * ::pow(10.f, -3.f * i / n);
+            seed = seed * 1664525u + 1013904223u;
+            L[i] = env * (float(seed) / 2147483648.f - 1.f);
+            seed = seed * 1664525u + 1013904223u;
+            R[i] = env * (float(seed) / 2147483648.f - 1.f);
+        }
+        reverb.set(L.data(), R.data(), n);
+    }
+
     SynthGUIManager<PluckedString> synthManager {"pluck"};
 };
 
@@ -18,6 +18,11 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/Fused.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Vbap.hpp"
+
 //using namespace gam;
 using namespace al;
 
@@ -27,10 +32,10 @@ class SineEnv : public SynthVoice {
 public:
 
     // Unit generators
-    gam::Pan<> mPan;
+    VbapPanner mSpat; // pans over the speakers of vbap()
     gam::Sine<> mOsc;
     gam::Env<3> mAmpEnv;
-    gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
 
     // Additional members
     Mesh mMesh;
@@ -60,19 +65,25 @@ public:
         mOsc.freq(getInternalParameterValue("frequency"));
         mAmpEnv.lengths()[0] = getInternalParameterValue("attackTime");
         mAmpEnv.lengths()[2] = getInternalParameterValue("releaseTime");
-        mPan.pos(getInternalParameterValue("pan"));
+        mSpat.position(vbap(), vbap().azimuthOfPan(getInternalParameterValue("pan")));
+
+        // Oscillator times envelope, evaluated as one fused loop per chunk
+        // over the frames from the voice's offset on
+        auto osc = fused::gen(mOsc);
+        auto env = fused::gen(mAmpEnv);
+        auto out = fused::stream(osc * env * getInternalParameterValue("amplitude"),
+                                 io.framesPerBuffer() - io.frame());
         while(io()){
-            float s1 = mOsc() * mAmpEnv() * getInternalParameterValue("amplitude");
-            float s2;
-            mEnvFollow(s1);
-            mPan(s1, s1,s2);
-            io.out(0) += s1;
-            io.out(1) += s2;
+            float s1 = out();
+            mPeak(s1);
+            mSpat(s1);
         }
+        mSpat.render(io); // Add the block to the speakers
         // We need to let the synth know that this voice is done
         // by calling the free(). This takes the voice out of the
         // rendering chain
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
     virtual void onProcess(Graphics &g) {
@@ -81,13 +92,14 @@ public:
         g.pushMatrix();
         g.translate(frequency/200 - 3,  amplitude, -8);
         g.scale(1- amplitude, amplitude, 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
 
     virtual void onTriggerOn() override {
         mAmpEnv.reset();
+        mSpat.reset();
     }
 
     virtual void onTriggerOff() override {
@@ -120,7 +132,9 @@ public:
 
     // The audio callback function. Called when audio hardware requires data
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     // The graphics callback function.
@@ -172,8 +186,11 @@ int main(){    // Create app instance
 
     app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
 
-    // Set up audio
-    app.initAudio(48000., 256, 2, 0);
+    // Speaker layout, stereo unless synth1-data/speakers.txt exists
+    vbap().load("synth1-data/speakers.txt");
+
+    // Set up audio, one output channel per speaker
+    app.initAudio(48000., 256, vbap().numChannels(), 0);
     // Set sampling rate for Gamma objects from app's audio
     gam::sampleRate(app.audioIO().framesPerSecond());
     app.audioIO().print();
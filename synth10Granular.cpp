@@ -0,0 +1,354 @@
+/*    Gamma - Generic processing library
+    See COPYRIGHT file for authors and license information
+
+    Example:        Synth 10 Granular
+    Description:    Clouds of short grains read from the synth2 tables or from
+                    sound files. Sources 0-8 are the tables of synth2.cpp,
+                    played at the voice frequency; sources from 9 on are the
+                    WAV files in synth10-data/samples in alphabetical order,
+                    played at their own pitch when the frequency is 261.6 Hz
+                    (middle C).
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>               // for printing to stdout
+#include <dirent.h>
+#define GAMMA_H_INC_ALL         // define this to include all header files
+#define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
+
+#include "Gamma/Gamma.h"
+#include "Gamma/Types.h"
+
+#include "al/core/app/al_App.hpp"
+#include "al/core/graphics/al_Shapes.hpp"
+#include "al/util/ui/al_Parameter.hpp"
+#include "al/util/scene/al_PolySynth.hpp"
+#include "al/util/scene/al_SynthSequencer.hpp"
+#include "al/util/ui/al_ControlGUI.hpp"
+
+#include "dsp/GrainPool.hpp"
+#include "dsp/SampleStreamer.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+
+using namespace al;
+
+// tables for grains, the same as synth2.cpp
+gam::ArrayPow2<float>
+    tbSaw(2048), tbSqr(2048), tbImp(2048), tbSin(2048), tbPls(2048),
+    tb__1(2048), tb__2(2048), tb__3(2048), tb__4(2048);
+
+// sound files for grains, mixed to mono and kept in memory
+std::vector<std::vector<float>> grainSamples;
+
+// Grain sources by number: tables then sound files
+std::vector<GrainSource> grainSources;
+
+class Granular : public SynthVoice {
+public:
+
+    // Enough for the top of the parameter ranges: density 4000 x
+    // grainSize 0.5 is 2000 overlapping grains
+    GrainPool<2048> mGrains;
+    std::vector<float> mL, mR;  // grains of one block
+    gam::ADSR<> mAmpEnv;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
+    GrainSource mSource;
+    double mNextGrain = 0;      // samples until the next grain starts
+    uint32_t mSeed = 1;
+    bool mReleased = false;    // no new grains after note off
+
+    // Additional members
+    Mesh mMesh;
+
+    virtual void init() {
+        // Buffers grow on the audio thread only for blocks over 4096 samples
+        mL.resize(4096);
+        mR.resize(4096);
+
+        mAmpEnv.curve(0); // make segments lines
+        mAmpEnv.levels(0,1,1,0);
+        mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
+
+        addDisc(mMesh, 1.0, 30);
+
+        createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0);
+        createInternalTriggerParameter("frequency", 261.6, 20, 5000);
+        createInternalTriggerParameter("attackTime", 0.5, 0.01, 10.0);
+        createInternalTriggerParameter("releaseTime", 2.0, 0.01, 20.0);
+        createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+        createInternalTriggerParameter("source", 3, 0, 40); // 0-8: tables, 9-: samples
+        createInternalTriggerParameter("density", 100, 1, 4000); // grains per second
+        createInternalTriggerParameter("grainSize", 0.05, 0.002, 0.5); // seconds
+        createInternalTriggerParameter("position", 0.0, 0.0, 1.0); // in a sample
+        createInternalTriggerParameter("scatter", 0.1, 0.0, 1.0); // random offset of position, pan and pitch
+    }
+
+    virtual void onProcess(AudioIOData& io) override {
+        // A note starting mid-block plays from its offset on
+        unsigned n = io.framesPerBuffer() - io.frame();
+        if(mL.size() < n){ mL.resize(n); mR.resize(n); }
+        std::fill(mL.begin(), mL.begin() + n, 0.f);
+        std::fill(mR.begin(), mR.begin() + n, 0.f);
+
+        if(!mReleased) spawnGrains(n, io.framesPerSecond());
+        if(mSource.data) mGrains.render(mSource, mL.data(), mR.data(), n);
+
+        float amp = getInternalParameterValue("amplitude");
+        unsigned i = 0;
+        while(io()){
+            float env = mAmpEnv() * amp;
+            float s1 = mL[i] * env;
+            float s2 = mR[i] * env;
+            ++i;
+            mPeak(s1);
+            mPeak(s2);
+            io.out(0) += s1;
+            io.out(1) += s2;
+        }
+        mPeak.endBlock();
+        if(mAmpEnv.done() && (mGrains.size() == 0 || voiceRetirement().silent(mPeak.value()))){
+            mGrains.clear();
+            free();
+        }
+    }
+
+    virtual void onProcess(Graphics &g) {
+        float density = getInternalParameterValue("density");
+        float amplitude = getInternalParameterValue("amplitude");
+        g.pushMatrix();
+        g.translate(getInternalParameterValue("pan"), amplitude, -4);
+        g.scale(0.1 + mGrains.size() / 200.f, 0.1 + mGrains.size() / 200.f, 1);
+        g.color(mPeak.value() * 4, density / 4000, 0.5, 0.4);
+        g.draw(mMesh);
+        g.popMatrix();
+    }
+
+    virtual void onTriggerOn() override {
+        mAmpEnv.attack(getInternalParameterValue("attackTime"));
+        mAmpEnv.decay(getInternalParameterValue("attackTime"));
+        mAmpEnv.release(getInternalParameterValue("releaseTime"));
+        mAmpEnv.reset();
+
+        unsigned src = unsigned(getInternalParameterValue("source"));
+        mSource = src < grainSources.size() ? grainSources[src] : GrainSource();
+        mGrains.clear();
+        mNextGrain = 0;
+        mReleased = false;
+        if(deterministic().enabled()) mSeed = deterministic().voiceSeed(id());
+        else mSeed = mSeed * 1664525u + 1013904223u;  // differ from the last note
+        if(mSeed == 0) mSeed = 1;
+    }
+
+    virtual void onTriggerOff() override {
+        mAmpEnv.triggerRelease();
+        mReleased = true;
+    }
+
+    // Uniform random number in [-1, 1)
+    float noise() {
+        mSeed ^= mSeed << 13;
+        mSeed ^= mSeed >> 17;
+        mSeed ^= mSeed << 5;
+        return float(mSeed) * (2.f / 4294967296.f) - 1.f;
+    }
+
+    void spawnGrains(unsigned n, double sampleRate) {
+        if(!mSource.data) return;
+        float density = getInternalParameterValue("density");
+        float size = getInternalParameterValue("grainSize");
+        float scatter = getInternalParameterValue("scatter");
+        float pan = getInternalParameterValue("pan");
+        float freq = getInternalParameterValue("frequency");
+
+        // Overlapping grains add up; keep the level independent of density
+        float overlap = density * size;
+        float amp = 1.f / std::sqrt(overlap > 1.f ? overlap : 1.f);
+        double interval = sampleRate / density;
+        unsigned length = unsigned(size * sampleRate);
+
+        // Tables play one cycle at the frequency, samples relative to middle C
+        float inc = mSource.wrap ? freq * mSource.frames / float(sampleRate)
+                                 : freq / 261.6f;
+        double start = mSource.wrap ? 0.0
+                     : double(getInternalParameterValue("position")) * mSource.frames;
+
+        while(mNextGrain < n){
+            Grain g;
+            g.offset = unsigned(mNextGrain);
+            g.length = length;
+            g.amplitude = amp;
+            g.increment = inc * std::pow(2.f, scatter * noise() / 12.f);  // up to a semitone
+            g.position = start + (mSource.wrap ? (noise() + 1.f) * 0.5f
+                                               : scatter * noise()) * mSource.frames;
+            if(g.position < 0) g.position = 0;
+            float p = pan + scatter * noise();
+            p = p < -1.f ? -1.f : (p > 1.f ? 1.f : p);
+            g.gainL = std::sqrt(0.5f * (1.f - p));
+            g.gainR = std::sqrt(0.5f * (1.f + p));
+            mGrains.spawn(g);
+            mNextGrain += interval;
+        }
+        mNextGrain -= n;
+    }
+};
+
+
+// We make an app.
+class MyApp : public App
+{
+public:
+
+    virtual void onInit( ) override {
+        gam::addSinesPow<1>(tbSaw, 9,1);
+        gam::addSinesPow<1>(tbSqr, 9,2);
+        gam::addSinesPow<0>(tbImp, 9,1);
+        gam::addSine(tbSin);
+
+        {    float A[] = {1,1,1,1,0.7,0.5,0.3,0.1};
+            gam::addSines(tbPls, A,8);
+        }
+
+        {    float A[] = {1, 0.4, 0.65, 0.3, 0.18, 0.08};
+            float C[] = {1,4,7,11,15,18};
+            gam::addSines(tb__1, A,C,6);
+        }
+
+        // inharmonic partials
+        {    float A[] = {0.5,0.8,0.7,1,0.3,0.4,0.2,0.12};
+            float C[] = {3,4,7,8,11,12,15,16};
+            gam::addSines(tb__2, A,C,8);
+        }
+
+        // inharmonic partials
+        {    float A[] = {1, 0.7, 0.45, 0.3, 0.15, 0.08};
+            float C[] = {10, 27, 54, 81, 108, 135};
+            gam::addSines(tb__3, A,C,6);
+        }
+
+        // harmonics 20-27
+        {    float A[] = {0.2, 0.4, 0.6, 1, 0.7, 0.5, 0.3, 0.1};
+            gam::addSines(tb__4, A,8, 20);
+        }
+
+        gam::ArrayPow2<float> * tables[] = {
+            &tbSaw, &tbSqr, &tbImp, &tbSin, &tbPls, &tb__1, &tb__2, &tb__3, &tb__4
+        };
+        for(auto * t : tables){
+            GrainSource s;
+            s.data = &(*t)[0];
+            s.frames = t->size();
+            s.wrap = true;
+            grainSources.push_back(s);
+        }
+
+        loadSamples("synth10-data/samples/");
+    }
+
+    // Read every WAV file in a folder into memory as mono
+    void loadSamples(const std::string& dir) {
+        std::vector<std::string> files;
+        if(DIR * d = opendir(dir.c_str())){
+            while(dirent * e = readdir(d)){
+                std::string name = e->d_name;
+                if(name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) files.push_back(name);
+            }
+            closedir(d);
+        }
+        std::sort(files.begin(), files.end());
+        for(auto& f : files){
+            WavReader wav;
+            if(!wav.open(dir + f) || wav.frames() == 0) continue;
+            const unsigned ch = wav.channels();
+            std::vector<float> frames(wav.frames() * ch);
+            unsigned n = wav.read(0, frames.data(), unsigned(wav.frames()));
+            std::vector<float> mono(n);
+            for(unsigned i=0; i<n; ++i){
+                float sum = 0;
+                for(unsigned c=0; c<ch; ++c) sum += frames[i * ch + c];
+                mono[i] = sum / ch;
+            }
+            grainSamples.push_back(std::move(mono));
+            GrainSource s;
+            s.data = grainSamples.back().data();
+            s.frames = n;
+            grainSources.push_back(s);
+            std::printf("source %u: %s\n", unsigned(grainSources.size() - 1), f.c_str());
+        }
+    }
+
+    virtual void onCreate() override {
+        ParameterGUI::initialize();
+        synthManager.synthRecorder().verbose(true);
+    }
+
+    virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
+    }
+
+    virtual void onDraw(Graphics &g) override {
+        g.clear();
+        synthManager.render(g);
+
+        // Draw GUI
+        ParameterGUI::beginDraw();
+        ParameterGUI::beginPanel(synthManager.name());
+        synthManager.drawSynthWidgets();
+        ParameterGUI::endPanel();
+        ParameterGUI::endDraw();
+    }
+
+    virtual void onKeyDown(Keyboard const& k) override {
+      if (ParameterGUI::usingKeyboard()) { //Ignore keys if GUI is using them
+        return;
+      }
+        if (k.shift()) {
+            // If shift pressed then keyboard sets preset
+            int presetNumber = asciiToIndex(k.key());
+            synthManager.recallPreset(presetNumber);
+        } else {
+            // Otherwise trigger note for polyphonic synth
+            int midiNote = asciiToMIDI(k.key());
+            if (midiNote > 0) {
+              synthManager.voice()->setInternalParameterValue("frequency", ::pow(2.f, (midiNote - 69.f)/12.f) * 432.f);
+              synthManager.triggerOn(midiNote);
+            }
+        }
+    }
+
+    virtual void onKeyUp(Keyboard const& k) override {
+        int midiNote = asciiToMIDI(k.key());
+        if (midiNote > 0) {
+            synthManager.triggerOff(midiNote);
+        }
+    }
+
+    void onExit() override {
+        ParameterGUI::cleanup();
+    }
+
+    // GUI manager for Granular voices
+    // The name provided determines the name of the directory
+    // where the presets and sequences are stored
+    SynthGUIManager<Granular> synthManager {"synth10"};
+};
+
+
+int main(){    // Create app instance
+    MyApp app;
+
+    app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
+
+    // Set up audio
+    app.initAudio(48000., 256, 2, 0);
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(app.audioIO().framesPerSecond());
+    app.audioIO().print();
+
+    app.start();
+    return 0;
+}
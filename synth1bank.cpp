@@ -0,0 +1,158 @@
+/*    Gamma - Generic processing library
+    See COPYRIGHT file for authors and license information
+
+    Example:        Synth 1 Bank
+    Description:    Dense chords of SineEnv voices. The sound is the same as
+                    synth1.cpp, but the voices are rendered in lockstep by a
+                    SynthVoiceBank, eight to a SIMD group.
+*/
+
+#include <cstdio>               // for printing to stdout
+#define GAMMA_H_INC_ALL         // define this to include all header files
+#define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
+
+#include "Gamma/Gamma.h"
+#include "Gamma/Types.h"
+
+#include "al/core/app/al_App.hpp"
+#include "al/core/graphics/al_Shapes.hpp"
+#include "al/util/ui/al_Parameter.hpp"
+#include "al/util/scene/al_PolySynth.hpp"
+#include "al/util/scene/al_SynthSequencer.hpp"
+#include "al/util/ui/al_ControlGUI.hpp"
+
+#include "dsp/SineEnvLanes.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+#include "engine/SynthVoiceBank.hpp"
+
+using namespace al;
+
+// All SineEnv voices are rendered here, eight lanes per group
+SynthVoiceBank<SineEnvLanes, 8> sineBank {32};
+
+// The voice is a handle to one lane of the bank, so notes can still be
+// played from the keyboard, recorded and sequenced like any other voice.
+class SineBank : public SynthVoice {
+public:
+    SynthVoiceBank<SineEnvLanes, 8>::Handle mLane;
+
+    virtual void init(){
+        createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0);
+        createInternalTriggerParameter("frequency", 60, 20, 5000);
+        createInternalTriggerParameter("attackTime", 1.0, 0.01, 3.0);
+        createInternalTriggerParameter("releaseTime", 3.0, 0.1, 10.0);
+        createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+    }
+
+    virtual void onProcess(AudioIOData& io) override {
+        // Audio is rendered by sineBank in MyApp::onSound()
+        if(!sineBank.active(mLane)) free();
+    }
+
+    virtual void onTriggerOn() override {
+        SineEnvLanes<8>::Params p;
+        p.amplitude = getInternalParameterValue("amplitude");
+        p.frequency = getInternalParameterValue("frequency");
+        p.attackTime = getInternalParameterValue("attackTime");
+        p.releaseTime = getInternalParameterValue("releaseTime");
+        p.pan = getInternalParameterValue("pan");
+        mLane = sineBank.start(p);
+    }
+
+    virtual void onTriggerOff() override {
+        sineBank.release(mLane);
+    }
+};
+
+class MyApp : public App
+{
+public:
+    virtual void onCreate() override {
+        ParameterGUI::initialize();
+        synthManager.synthRecorder().verbose(true);
+    }
+
+    virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        synthManager.render(io); // Start and release voices
+        sineBank.render(io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+    }
+
+    virtual void onDraw(Graphics &g) override {
+        g.clear();
+        synthManager.render(g);
+
+        // Draw GUI
+        ParameterGUI::beginDraw();
+        ParameterGUI::beginPanel(synthManager.name());
+        if (ImGui::Button("Cluster")) {
+            playCluster(0, 48);
+        }
+        ImGui::SameLine();
+        ImGui::Text("%u voices in %u groups", sineBank.numActive(),
+                    sineBank.numGroupsRendered());
+        ImGui::Separator();
+        synthManager.drawSynthWidgets();
+        ParameterGUI::endPanel();
+        ParameterGUI::endDraw();
+    }
+
+    virtual void onKeyDown(Keyboard const& k) override {
+      if (ParameterGUI::usingKeyboard()) { //Ignore keys if GUI is using them
+        return;
+      }
+        if (k.shift()) {
+            // If shift pressed then keyboard sets preset
+            int presetNumber = asciiToIndex(k.key());
+            synthManager.recallPreset(presetNumber);
+        } else {
+            // Otherwise trigger note for polyphonic synth
+            int midiNote = asciiToMIDI(k.key());
+            if (midiNote > 0) {
+              synthManager.voice()->setInternalParameterValue("frequency", ::pow(2.f, (midiNote - 69.f)/12.f) * 432.f);
+              synthManager.triggerOn(midiNote);
+            }
+        }
+    }
+
+    virtual void onKeyUp(Keyboard const& k) override {
+        int midiNote = asciiToMIDI(k.key());
+        if (midiNote > 0) {
+            synthManager.triggerOff(midiNote);
+        }
+    }
+
+    void onExit() override {
+        ParameterGUI::cleanup();
+    }
+
+    // Play count notes of a 12TET chromatic cluster together from time start
+    void playCluster(float start, int count) {
+        for (int i = 0; i < count; i++) {
+            auto *voice = synthManager.synth().getVoice<SineBank>();
+            voice->setInternalParameterValue("amplitude", 0.3f / count);
+            voice->setInternalParameterValue("frequency", 110 * ::pow(2.f, i / 12.f));
+            voice->setInternalParameterValue("attackTime", 2.0);
+            voice->setInternalParameterValue("releaseTime", 3.0);
+            voice->setInternalParameterValue("pan", deterministic().random().uni(-1.f, 1.f));
+            synthManager.synthSequencer().addVoiceFromNow(voice, start, 4.0);
+        }
+    }
+
+    SynthGUIManager<SineBank> synthManager {"synth1bank"};
+};
+
+
+int main(){
+    MyApp app;
+    app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
+    // Set up audio
+    app.initAudio(48000., 256, 2, 0);
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(app.audioIO().framesPerSecond());
+    app.audioIO().print();
+
+    app.start();
+    return 0;
+}
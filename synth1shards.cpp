@@ -0,0 +1,165 @@
+/*    Gamma - Generic processing library
+    See COPYRIGHT file for authors and license information
+
+    Example:        Synth 1 Shards
+    Description:    The synth1 sequence rendered by several processes. The
+                    events are split into shards, each played by its own
+                    render process, and the sub-mixes are summed through
+                    shared memory by this process, which owns the audio
+                    device. See engine/RenderShard.hpp.
+
+    Usage:          synth1shards [shards] [event|class] [offline]
+
+                    shards      render processes (default 4)
+                    event       spread events over the shards by a hash of
+                                their position (default); class keeps each
+                                voice class in one shard
+                    offline     mix 30 s as fast as possible without audio
+                                and print how long it took
+*/
+
+#include <cstdio>               // for printing to stdout
+#include <cstdlib>
+#include <string>
+#define GAMMA_H_INC_ALL         // define this to include all header files
+#define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
+
+#include "Gamma/Gamma.h"
+
+#include "al/core/io/al_AudioIO.hpp"
+#include "al/util/scene/al_PolySynth.hpp"
+#include "al/util/scene/al_SynthSequencer.hpp"
+
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/RenderShard.hpp"
+
+using namespace al;
+
+static const double kSampleRate = 48000;
+static const unsigned kBlock = 256;
+
+// The SineEnv voice of synth1.cpp, without graphics
+class SineEnv : public SynthVoice {
+public:
+
+    gam::Pan<> mPan;
+    gam::Sine<> mOsc;
+    gam::Env<3> mAmpEnv;
+    BlockPeak mPeak;
+
+    virtual void init() {
+        mAmpEnv.curve(0); // make segments lines
+        mAmpEnv.levels(0,1,1,0);
+        mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
+
+        createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0);
+        createInternalTriggerParameter("frequency", 60, 20, 5000);
+        createInternalTriggerParameter("attackTime", 1.0, 0.01, 3.0);
+        createInternalTriggerParameter("releaseTime", 3.0, 0.1, 10.0);
+        createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+    }
+
+    virtual void onProcess(AudioIOData& io) override {
+        mOsc.freq(getInternalParameterValue("frequency"));
+        mAmpEnv.lengths()[0] = getInternalParameterValue("attackTime");
+        mAmpEnv.lengths()[2] = getInternalParameterValue("releaseTime");
+        mPan.pos(getInternalParameterValue("pan"));
+        float amp = getInternalParameterValue("amplitude");
+        while(io()){
+            float s1 = mOsc() * mAmpEnv() * amp;
+            float s2;
+            mPeak(s1);
+            mPan(s1, s1,s2);
+            io.out(0) += s1;
+            io.out(1) += s2;
+        }
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
+    }
+
+    virtual void onTriggerOn() override {
+        mAmpEnv.reset();
+    }
+
+    virtual void onTriggerOff() override {
+        mAmpEnv.release();
+    }
+};
+
+
+RenderShards shards;
+
+// Body of each render process: play this shard's sequence a block at a
+// time into its ring, until the coordinator stops it
+void renderShard(unsigned shard, ShardRing& ring){
+    disableDenormals();
+    gam::sampleRate(kSampleRate);
+
+    SynthSequencer seq;
+    seq.synth().registerSynthClass<SineEnv>("SineEnv");
+    seq.setDirectory("synth1-data");
+    seq.playSequence("shard-" + std::to_string(shard) + ".synthSequence");
+
+    AudioIOData io;
+    io.framesPerSecond(kSampleRate);
+    io.framesPerBuffer(kBlock);
+    io.channelsOut(2);
+    const float * out[2];
+    do {
+        io.zeroOut();
+        io.frame(0);
+        seq.render(io);
+        voiceRetirement().observeMix(io); // Retire voices against this shard's mix
+        out[0] = io.outBuffer(0);
+        out[1] = io.outBuffer(1);
+    } while(ring.write(out, kBlock));
+}
+
+// The coordinator's audio callback only sums the sub-mixes
+void audioCB(AudioIOData& io){
+    DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+    shards.mix(io);
+}
+
+int main(int argc, char * argv[]){
+    unsigned numShards = argc > 1 ? std::atoi(argv[1]) : 4;
+    shard::Partition by = argc > 2 && std::string(argv[2]) == "class" ? shard::BY_CLASS : shard::BY_EVENT;
+    bool offline = argc > 3 && std::string(argv[3]) == "offline";
+    if(numShards < 1) numShards = 1;
+
+    if(!shard::splitSequence("synth1-data/synth1.synthSequence", numShards, by, "synth1-data/shard")){
+        printf("could not split synth1-data/synth1.synthSequence\n");
+        return 1;
+    }
+    // Fork the render processes before any thread or audio device exists;
+    // they may run up to 8 blocks ahead
+    if(!shards.launch("/synthtutorial-synth1", numShards, 2, 8 * kBlock, renderShard)) return 1;
+
+    if(offline){
+        float L[kBlock], R[kBlock];
+        float * out[2] = {L, R};
+        float peak = 0;
+        unsigned blocks = unsigned(30 * kSampleRate / kBlock);
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned b=0; b<blocks; ++b){
+            for(unsigned i=0; i<kBlock; ++i) L[i] = R[i] = 0;
+            shards.mix(out, 2, kBlock, -1);
+            peak = std::max(peak, blockPeak(L, kBlock));
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("30 s mixed from %u shards in %.2f s, peak %.3f\n", numShards, seconds, peak);
+        shards.stop();
+        return 0;
+    }
+
+    AudioIO io;
+    io.init(audioCB, nullptr, kBlock, kSampleRate, 2, 0);
+    io.start();
+    printf("\nPress 'enter' or Ctrl-C to quit...\n");
+    getchar();
+    io.stop();
+    printf("%u late blocks\n", shards.late());
+    shards.stop();
+    return 0;
+}
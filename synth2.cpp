@@ -19,6 +19,14 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/BlepOsc.hpp"
+#include "dsp/MorphTable.hpp"
+#include "dsp/WavetableLibrary.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/LodGovernor.hpp"
+#include "engine/VoiceAdmission.hpp"
+
 //using namespace gam;
 using namespace al;
 
@@ -27,6 +35,14 @@ gam::ArrayPow2<float>
     tbSaw(2048), tbSqr(2048), tbImp(2048), tbSin(2048), tbPls(2048),
     tb__1(2048), tb__2(2048), tb__3(2048), tb__4(2048);
 
+// once saved, the tables above are mapped from here instead of built
+WavetableLibrary tbLibrary;
+const char * tbLibraryPath = "synth2-data/tables.wtl";
+const uint64_t tbLibraryTag = 1;    // bump whenever buildTables() changes
+
+// the same nine tables as frames 0-8 of a morphing wavetable
+WaveFrames tbFrames;
+
 // This is the same SineEnv class defined in graphics/synth1.cpp
 // It inclludes drawing code
 class OscEnv : public SynthVoice {
@@ -35,8 +51,14 @@ public:
     // Unit generators
     gam::Pan<> mPan;
     gam::Osc<> mOsc;
+    BlepOsc mBlep;          // band-limited saw/square/pulse/triangle, tables 9-12
+    bool mUseBlep = false;
+    MorphOsc mMorph;        // glides through tbFrames, table 13
+    bool mUseMorph = false;
+    gam::Osc<float, gam::ipl::Trunc> mOscTrunc; // used above quality tier 0
+    int mLod = 0;  // quality tier, latched at note on
     gam::ADSR<> mAmpEnv;
-    gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
 
     // Additional members
     Mesh mMesh;
@@ -59,16 +81,24 @@ public:
         createInternalTriggerParameter("sustain", 0.7, 0.0, 1.0);
         createInternalTriggerParameter("curve", 4.0, -10.0, 10.0);
         createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
-        createInternalTriggerParameter("table", 0, 0, 8);
+        createInternalTriggerParameter("table", 0, 0, 13); // 9-12: BlepOsc waves, 13: morph
+        createInternalTriggerParameter("pulseWidth", 0.5, 0.01, 0.99);
+        createInternalTriggerParameter("morphStart", 0, 0, 8);
+        createInternalTriggerParameter("morphEnd", 8, 0, 8);
+        createInternalTriggerParameter("morphTime", 2.0, 0.0, 10.0);
+
+        mMorph.source(tbFrames);
     }
 
     //
     virtual void onProcess(AudioIOData& io) override {
         updateFromParameters();
         while(io()){
-            float s1 = 0.1 * mOsc() * mAmpEnv() * getInternalParameterValue("amplitude");
+            float osc = mUseBlep ? mBlep() : mUseMorph ? mMorph()
+                      : (mLod > 0 ? mOscTrunc() : mOsc());
+            float s1 = 0.1 * osc * mAmpEnv() * getInternalParameterValue("amplitude");
             float s2;
-            mEnvFollow(s1);
+            mPeak(s1);
             mPan(s1, s1,s2);
             io.out(0) += s1;
             io.out(1) += s2;
@@ -76,7 +106,8 @@ public:
         // We need to let the synth know that this voice is done
         // by calling the free(). This takes the voice out of the
         // rendering chain
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
     virtual void onProcess(Graphics &g) {
@@ -85,7 +116,7 @@ public:
         g.pushMatrix();
         g.translate(amplitude,  amplitude, -4);
         g.scale(frequency/200, frequency/400, 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -93,18 +124,37 @@ public:
     virtual void onTriggerOn() override {
         mAmpEnv.reset();
         updateFromParameters();
+        mLod = lod().tier();
         // Map table number to table in memory
+        gam::ArrayPow2<float> * table = &tbSaw;
         switch (int(getInternalParameterValue("table"))) {
-        case 0: mOsc.source(tbSaw); break;
-        case 1: mOsc.source(tbSqr); break;
-        case 2: mOsc.source(tbImp); break;
-        case 3: mOsc.source(tbSin); break;
-        case 4: mOsc.source(tbPls); break;
-        case 5: mOsc.source(tb__1); break;
-        case 6: mOsc.source(tb__2); break;
-        case 7: mOsc.source(tb__3); break;
-        case 8: mOsc.source(tb__4); break;
+        case 0: table = &tbSaw; break;
+        case 1: table = &tbSqr; break;
+        case 2: table = &tbImp; break;
+        case 3: table = &tbSin; break;
+        case 4: table = &tbPls; break;
+        case 5: table = &tb__1; break;
+        case 6: table = &tb__2; break;
+        case 7: table = &tb__3; break;
+        case 8: table = &tb__4; break;
+        case 9: mBlep.wave(BlepOsc::SAW); break;
+        case 10: mBlep.wave(BlepOsc::SQUARE); break;
+        case 11: mBlep.wave(BlepOsc::PULSE); break;
+        case 12: mBlep.wave(BlepOsc::TRIANGLE); break;
+        case 13:
+            // Sweep from one table to another while the note plays
+            mMorph.position(getInternalParameterValue("morphStart"));
+            mMorph.glide(getInternalParameterValue("morphEnd"),
+                         getInternalParameterValue("morphTime"));
+            break;
         }
+        // Tables 9-12 are computed and need no table memory
+        mUseBlep = int(getInternalParameterValue("table")) >= 9
+                && int(getInternalParameterValue("table")) <= 12;
+        mUseMorph = int(getInternalParameterValue("table")) == 13;
+        mBlep.width(getInternalParameterValue("pulseWidth"));
+        mOsc.source(*table);
+        mOscTrunc.source(*table);
     }
 
     virtual void onTriggerOff() override {
@@ -113,6 +163,9 @@ public:
 
     void updateFromParameters() {
         mOsc.freq(getInternalParameterValue("frequency"));
+        mOscTrunc.freq(getInternalParameterValue("frequency"));
+        mBlep.freq(getInternalParameterValue("frequency"));
+        mMorph.freq(getInternalParameterValue("frequency"));
         mAmpEnv.attack(getInternalParameterValue("attackTime"));
         mAmpEnv.decay(getInternalParameterValue("attackTime"));
         mAmpEnv.release(getInternalParameterValue("releaseTime"));
@@ -129,6 +182,38 @@ class MyApp : public App
 public:
 
     virtual void onInit( ) override {
+        gam::ArrayPow2<float> * tables[] = {
+            &tbSaw, &tbSqr, &tbImp, &tbSin, &tbPls, &tb__1, &tb__2, &tb__3, &tb__4
+        };
+        const char * names[] = {
+            "saw", "square", "impulse", "sine", "pulse", "tb__1", "tb__2", "tb__3", "tb__4"
+        };
+
+        // Use the saved library if it was built by this version of
+        // buildTables() and has every table, else build and save
+        bool mapped = tbLibrary.open(tbLibraryPath) && tbLibrary.tag() == tbLibraryTag;
+        for(unsigned i=0; mapped && i<9; ++i){
+            int t = tbLibrary.findTable(names[i]);
+            mapped = t >= 0 && tbLibrary.tableEntry(t).size == tables[i]->size();
+        }
+        if(mapped){
+            for(unsigned i=0; i<9; ++i) tbLibrary.attach(names[i], *tables[i]);
+        } else {
+            tbLibrary.close();
+            buildTables();
+            WavetableLibraryWriter writer;
+            writer.tag(tbLibraryTag);
+            for(unsigned i=0; i<9; ++i) writer.addTable(names[i], *tables[i]);
+            if(!writer.save(tbLibraryPath)){
+                std::printf("Could not save tables to %s\n", tbLibraryPath);
+            }
+        }
+
+        tbFrames.resize(9, 2048);
+        for(unsigned i=0; i<9; ++i) tbFrames.set(i, *tables[i]);
+    }
+
+    void buildTables() {
         gam::addSinesPow<1>(tbSaw, 9,1);
         gam::addSinesPow<1>(tbSqr, 9,2);
         gam::addSinesPow<0>(tbImp, 9,1);
@@ -170,7 +255,12 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        admission().beginCallback();
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
+        admission().endCallback(io.framesPerBuffer(), io.framesPerSecond());
+        lod().update(admission().headroom()); // Pick quality tier for new notes
     }
 
     virtual void onDraw(Graphics &g) override {
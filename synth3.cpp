@@ -13,6 +13,11 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/BlepOsc.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Ambisonics.hpp"
+#include "engine/Denormals.hpp"
+
 //using namespace gam;
 using namespace al;
 
@@ -25,12 +30,14 @@ class Vib : public SynthVoice {
 public:
 
     // Unit generators
-    gam::Pan<> mPan;
+    HoaEncoder mEncoder; // encodes into hoaBus()
     gam::Osc<> mOsc;
+    BlepOsc mBlep;          // band-limited saw/square/pulse/triangle, tables 9-12
+    bool mUseBlep = false;
     gam::Sine<> mVib;
     gam::ADSR<> mAmpEnv;
     gam::ADSR<> mVibEnv;
-    gam::EnvFollow<> mEnvFollow;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
     
     float vibValue;
 
@@ -51,11 +58,13 @@ public:
         createInternalTriggerParameter("releaseTime", 3.0, 0.1, 10.0);
         createInternalTriggerParameter("curve", 4.0, -10.0, 10.0);
         createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
-        createInternalTriggerParameter("table", 0, 0, 8);
+        createInternalTriggerParameter("table", 0, 0, 12); // 9-12: BlepOsc waves
         createInternalTriggerParameter("vibRate1", 3.5, 0.2, 20);
         createInternalTriggerParameter("vibRate2", 5.8, 0.2, 20);
         createInternalTriggerParameter("vibRise", 0.5, 0.1, 2);
         createInternalTriggerParameter("vibDepth", 0.005, 0.0, 0.3);
+        createInternalTriggerParameter("pulseWidth", 0.5, 0.01, 0.99);
+        createInternalTriggerParameter("elevation", 0.0, -90.0, 90.0);
     }
 
     virtual void onProcess(AudioIOData& io) override {
@@ -66,17 +75,27 @@ public:
         while(io()){
             mVib.freq(mVibEnv());
             vibValue = mVib();
-            mOsc.freq(oscFreq + vibValue*vibDepth*oscFreq);
-
-            float s1 = mOsc() * mAmpEnv() * amp;
-            float s2;
-            mEnvFollow(s1);
-            mPan(s1, s1,s2);
-            io.out(0) += s1;
-            io.out(1) += s2;
+            float freq = oscFreq + vibValue*vibDepth*oscFreq;
+            float osc;
+            if (mUseBlep) {
+              mBlep.freq(freq);
+              osc = mBlep();
+            } else {
+              mOsc.freq(freq);
+              osc = mOsc();
+            }
+
+            float s1 = osc * mAmpEnv() * amp;
+            mPeak(s1);
+            mEncoder(s1);
         }
+        // Pan -1..1 sweeps the front of the layout from left to right
+        mEncoder.position(hoaBus(), hoaBus().azimuthOfPan(getInternalParameterValue("pan")),
+                          getInternalParameterValue("elevation"));
+        mEncoder.render(hoaBus());
         //if(mAmpEnv.done()) free();
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
 virtual void onProcess(Graphics &g) {
@@ -86,7 +105,7 @@ virtual void onProcess(Graphics &g) {
         g.translate(amplitude,  amplitude, -4);
         float scaling = vibValue + getInternalParameterValue("vibDepth");
         g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -97,6 +116,7 @@ virtual void onProcess(Graphics &g) {
 
         mAmpEnv.reset();
         mVibEnv.reset();
+        mEncoder.reset();
         // Map table number to table in memory
         switch (int(getInternalParameterValue("table"))) {
         case 0: mOsc.source(tbSaw); break;
@@ -108,7 +128,14 @@ virtual void onProcess(Graphics &g) {
         case 6: mOsc.source(tb__2); break;
         case 7: mOsc.source(tb__3); break;
         case 8: mOsc.source(tb__4); break;
+        case 9: mBlep.wave(BlepOsc::SAW); break;
+        case 10: mBlep.wave(BlepOsc::SQUARE); break;
+        case 11: mBlep.wave(BlepOsc::PULSE); break;
+        case 12: mBlep.wave(BlepOsc::TRIANGLE); break;
         }
+        // Tables 9-12 are computed and need no table memory
+        mUseBlep = int(getInternalParameterValue("table")) >= 9;
+        mBlep.width(getInternalParameterValue("pulseWidth"));
     }
 
     virtual void onTriggerOff() override {
@@ -118,11 +145,11 @@ virtual void onProcess(Graphics &g) {
 
     void updateFromParameters() {
         mOsc.freq(getInternalParameterValue("frequency"));
+        mBlep.freq(getInternalParameterValue("frequency"));
         mAmpEnv.attack(getInternalParameterValue("attackTime"));
         mAmpEnv.decay(getInternalParameterValue("attackTime"));
         mAmpEnv.release(getInternalParameterValue("releaseTime"));
         mAmpEnv.curve(getInternalParameterValue("curve"));
-        mPan.pos(getInternalParameterValue("pan"));
         mVibEnv.levels(getInternalParameterValue("vibRate1"),
                        getInternalParameterValue("vibRate2"),
                        getInternalParameterValue("vibRate2"),
@@ -180,7 +207,11 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
-        synthManager.render(io); // Render audio
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        hoaBus().begin(io.framesPerBuffer()); // Clear the Ambisonics bus
+        synthManager.render(io); // Render audio; voices encode into the bus
+        hoaBus().decode(io); // Decode the bus to the speakers
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     virtual void onDraw(Graphics &g) override {
@@ -234,8 +265,13 @@ int main(){
 
     app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
 
-    // Set up audio
-    app.initAudio(48000., 256, 2, 0);
+    // Third-order Ambisonics decoded to synth3-data/speakers.txt, or stereo
+    SpeakerLayout speakers = SpeakerLayout::stereo();
+    speakers.load("synth3-data/speakers.txt");
+    hoaBus().init(3, speakers);
+
+    // Set up audio, one output channel per speaker
+    app.initAudio(48000., 256, speakers.numChannels(), 0);
     // Set sampling rate for Gamma objects from app's audio
     gam::sampleRate(app.audioIO().framesPerSecond());
     app.audioIO().print();
@@ -29,6 +29,12 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/Oversampler.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/LodGovernor.hpp"
+#include "engine/VoiceAdmission.hpp"
+
 
 //using namespace gam;
 using namespace al;
@@ -41,10 +47,18 @@ public:
     gam::Pan<> mPan;
     gam::ADSR<> mAmpEnv;
     gam::ADSR<> mModEnv;
-    gam::EnvFollow<> mEnvFollow;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
     
     gam::Sine<> car, mod;    // carrier, modulator sine oscillators
 
+    // Above tier 0 the FM index is updated at control rate
+    static const int kIndexPeriod = 16;
+    int mLod = 0;            // quality tier, latched at note on
+    int mIndexCount = 0;     // samples left until the next index update
+    float mIndex = 0;
+
+    Oversampler mOversampler;  // 2x or 4x for bright presets, set by "oversample"
+
     // Additional members
     Mesh mMesh;
 
@@ -70,6 +84,7 @@ public:
       createInternalTriggerParameter("modMul", 1.0007, 0.0, 20.0);
 
       createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+      createInternalTriggerParameter("oversample", 1, 1, 4); // 1, 2 or 4
     }
 
     //
@@ -79,16 +94,31 @@ public:
         float carBaseFreq = getInternalParameterValue("freq")*getInternalParameterValue("carMul");
         float modScale = getInternalParameterValue("freq") * getInternalParameterValue("modMul");
         float amp = getInternalParameterValue("amplitude");
+
+        // Render the FM core at the oversampled rate, then decimate; a
+        // note starting mid-block only plays from its offset on
+        unsigned n = io.framesPerBuffer() - io.frame();
+        float * buf = mOversampler.begin(n);
+        for (unsigned i = 0; i < n * mOversampler.factor(); ++i) {
+          if (mIndexCount == 0) {
+            mIndex = mModEnv()*modScale;
+            mIndexCount = mLod > 0 ? kIndexPeriod : 1;
+          }
+          --mIndexCount;
+          car.freq(carBaseFreq + mod()*mIndex);
+          buf[i] = car() * mAmpEnv() * amp;
+        }
+        const float * out = mOversampler.end(n);
         while(io()){
-          car.freq(carBaseFreq + mod()*mModEnv()*modScale);
-          float s1 = car() * mAmpEnv() * amp;
+          float s1 = *out++;
           float s2;
-          mEnvFollow(s1);
+          mPeak(s1);
           mPan(s1, s1,s2);
           io.out(0) += s1;
           io.out(1) += s2;
         }
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
     virtual void onProcess(Graphics &g) {
@@ -96,7 +126,7 @@ public:
         g.translate(getInternalParameterValue("freq")/ 300 - 2,  getInternalParameterValue("modAmt")/25-1, -4);
         float scaling = getInternalParameterValue("amplitude")*1;
         g.scale(scaling, scaling , scaling* 1);
-        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mEnvFollow.value()* 10));
+        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mPeak.value()* 10));
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -119,6 +149,24 @@ public:
 
 //        mModEnv.lengths()[1] = mAmpEnv.lengths()[1];
 
+        unsigned factor = unsigned(getInternalParameterValue("oversample"));
+        if (factor != mOversampler.factor()) {
+          mOversampler.factor(factor);
+          // Units of the FM core tick at the oversampled rate
+          gam::Domain& d = oversampledDomain(mOversampler.factor());
+          car.domain(d);
+          mod.domain(d);
+          mAmpEnv.domain(d);
+          mModEnv.domain(d);
+        }
+
+        mLod = lod().tier();
+        if (mLod > 0) {
+          // The index envelope only advances once per kIndexPeriod samples
+          for (int i = 0; i < 3; ++i) mModEnv.lengths()[i] /= kIndexPeriod;
+        }
+        mIndexCount = 0;
+
         mAmpEnv.reset();
         mModEnv.reset();
     }
@@ -151,7 +199,12 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        admission().beginCallback();
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
+        admission().endCallback(io.framesPerBuffer(), io.framesPerSecond());
+        lod().update(admission().headroom()); // Pick quality tier for new notes
     }
 
     virtual void onDraw(Graphics &g) override {
@@ -31,6 +31,9 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+
 
 //using namespace gam;
 using namespace al;
@@ -43,7 +46,7 @@ public:
     gam::Pan<> mPan;
     gam::ADSR<> mAmpEnv;
     gam::ADSR<> mModEnv;
-    gam::EnvFollow<> mEnvFollow;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
     gam::ADSR<> mVibEnv;
     
     gam::Sine<> car, mod, mVib;    // carrier, modulator sine oscillators
@@ -102,12 +105,13 @@ public:
           car.freq( (1+ mVib()*mVibDepth)*carBaseFreq + mod()*mModEnv()*modScale);
           float s1 = car() * mAmpEnv() * amp;
           float s2;
-          mEnvFollow(s1);
+          mPeak(s1);
           mPan(s1, s1,s2);
           io.out(0) += s1;
           io.out(1) += s2;
         }
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
     virtual void onProcess(Graphics &g) {
@@ -115,7 +119,7 @@ public:
         g.translate(getInternalParameterValue("freq")/ 300 - 2,  (getInternalParameterValue("idx3") + getInternalParameterValue("idx2"))/15-1, -4);
         float scaling = getInternalParameterValue("amplitude")/3;
         g.scale(scaling, scaling , scaling* 1);
-        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mEnvFollow.value()* 10));
+        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mPeak.value()* 10));
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -181,7 +185,9 @@ public:
    }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     virtual void onDraw(Graphics &g) override {
@@ -19,6 +19,10 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/BlepOsc.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+
 //using namespace gam;
 using namespace al;
 
@@ -35,10 +39,12 @@ public:
     gam::Pan<> mPan;
     gam::Sine<> mTrm;
     gam::Osc<> mOsc;
+    BlepOsc mBlep;          // band-limited saw/square/pulse/triangle, tables 9-12
+    bool mUseBlep = false;
     gam::ADSR<> mTrmEnv;
     //gam::Env<2> mTrmEnv;
     gam::ADSR<> mAmpEnv;
-    gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
 
     // Additional members
     Mesh mMesh;
@@ -65,11 +71,12 @@ public:
         createInternalTriggerParameter("sustain", 0.7, 0.0, 1.0);
         createInternalTriggerParameter("curve", 4.0, -10.0, 10.0);
         createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
-        createInternalTriggerParameter("table", 0, 0, 8);
+        createInternalTriggerParameter("table", 0, 0, 12); // 9-12: BlepOsc waves
         createInternalTriggerParameter("trm1", 3.5, 0.2, 20);
         createInternalTriggerParameter("trm2", 5.8, 0.2, 20);
         createInternalTriggerParameter("trmRise", 0.5, 0.1, 2);
         createInternalTriggerParameter("trmDepth", 0.1, 0.0, 1.0);
+        createInternalTriggerParameter("pulseWidth", 0.5, 0.01, 0.99);
     }
 
     //
@@ -83,9 +90,10 @@ public:
             mTrm.freq(mTrmEnv());
             //float trmAmp = mAmp - mTrm()*mTrmDepth; // Replaced with line below
             float trmAmp = (mTrm()*0.5+0.5)*trmDepth + (1-trmDepth); // Corrected
-            float s1 = mOsc() * mAmpEnv() * trmAmp * amp;
+            float osc = mUseBlep ? mBlep() : mOsc();
+            float s1 = osc * mAmpEnv() * trmAmp * amp;
             float s2;
-            mEnvFollow(s1);
+            mPeak(s1);
             mPan(s1, s1,s2);
             io.out(0) += s1;
             io.out(1) += s2;
@@ -93,7 +101,8 @@ public:
         // We need to let the synth know that this voice is done
         // by calling the free(). This takes the voice out of the
         // rendering chain
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
 virtual void onProcess(Graphics &g) {
@@ -104,7 +113,7 @@ virtual void onProcess(Graphics &g) {
         g.scale(frequency/200, frequency/400, 1);
         //float scaling = trmDepth + getInternalParameterValue("trmDepth");
         //g.scale(scaling * frequency/200, scaling * frequency/400, scaling* 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -126,7 +135,14 @@ virtual void onProcess(Graphics &g) {
         case 6: mOsc.source(tb__2); break;
         case 7: mOsc.source(tb__3); break;
         case 8: mOsc.source(tb__4); break;
+        case 9: mBlep.wave(BlepOsc::SAW); break;
+        case 10: mBlep.wave(BlepOsc::SQUARE); break;
+        case 11: mBlep.wave(BlepOsc::PULSE); break;
+        case 12: mBlep.wave(BlepOsc::TRIANGLE); break;
         }
+        // Tables 9-12 are computed and need no table memory
+        mUseBlep = int(getInternalParameterValue("table")) >= 9;
+        mBlep.width(getInternalParameterValue("pulseWidth"));
     }
 
     virtual void onTriggerOff() override {
@@ -136,6 +152,7 @@ virtual void onProcess(Graphics &g) {
 
     void updateFromParameters() {
         mOsc.freq(getInternalParameterValue("frequency"));
+        mBlep.freq(getInternalParameterValue("frequency"));
         mAmpEnv.attack(getInternalParameterValue("attackTime"));
         mAmpEnv.decay(getInternalParameterValue("attackTime"));
         mAmpEnv.release(getInternalParameterValue("releaseTime"));
@@ -202,7 +219,9 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     virtual void onDraw(Graphics &g) override {
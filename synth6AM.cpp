@@ -19,6 +19,11 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/Fused.hpp"
+#include "dsp/Oversampler.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -34,8 +39,9 @@ public:
   gam::ADSR<> mAMEnv;
   gam::Sine<> mOsc;
   gam::ADSR<> mAmpEnv;
-  EnvFollow<> mEnvFollow;
+  BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
   Pan<> mPan;
+  Oversampler mOversampler;  // 2x or 4x against aliasing of square/pulse AM
 
   Mesh mMesh;
 
@@ -61,31 +67,38 @@ public:
     createInternalTriggerParameter("am2", 0.75, 0.1, 1.0);
     createInternalTriggerParameter("amRise", 0.75, 0.1, 1.0);
     createInternalTriggerParameter("amRatio", 0.75, 0.1, 1.0);
+    createInternalTriggerParameter("oversample", 1, 1, 4); // 1, 2 or 4
   }
 
   virtual void onProcess(AudioIOData& io) override {
     mOsc.freq(getInternalParameterValue("frequency"));
 
-    float amp = getInternalParameterValue("amplitude");
-    float amRatio = getInternalParameterValue("amRatio");
-    while(io()){
-
-      mAM.freq(mOsc.freq()*amRatio);            // set AM freq according to ratio
-      float amAmt = mAMEnv();                    // AM amount envelope
-
-      float s1 = mOsc();                        // non-modulated signal
-      s1 = s1*(1-amAmt) + (s1*mAM())*amAmt;    // mix modulated and non-modulated
+    mAM.freq(mOsc.freq()*getInternalParameterValue("amRatio")); // set AM freq according to ratio
 
-      s1 *= mAmpEnv() *amp;
+    float amp = getInternalParameterValue("amplitude");
 
+    // The signal graph, evaluated as one fused loop per chunk of samples
+    auto osc = fused::gen(mOsc);                // non-modulated signal
+    auto am = fused::gen(mAM);
+    auto amAmt = fused::gen(mAMEnv);            // AM amount envelope
+    auto env = fused::gen(mAmpEnv);
+    // mix modulated and non-modulated, then apply amplitude envelope,
+    // at the oversampled rate, for the frames from the voice's offset on
+    unsigned n = io.framesPerBuffer() - io.frame();
+    fused::render((osc*(1.f-amAmt) + osc*am*amAmt) * env * amp,
+                  mOversampler.begin(n), n * mOversampler.factor());
+    const float * out = mOversampler.end(n);
+    while(io()){
+      float s1 = *out++;
       float s2;
-      mEnvFollow(s1);
+      mPeak(s1);
       mPan(s1, s1,s2);
       io.out(0) += s1;
       io.out(1) += s2;
     }
     //if(mAmpEnv.done()) free();
-    if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+    mPeak.endBlock();
+    if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
   }
 
   virtual void onTriggerOn() override {
@@ -108,6 +121,17 @@ public:
 
     mPan.pos(getInternalParameterValue("pan"));
 
+    unsigned factor = unsigned(getInternalParameterValue("oversample"));
+    if (factor != mOversampler.factor()) {
+      mOversampler.factor(factor);
+      // All units of the voice tick at the oversampled rate
+      gam::Domain& d = oversampledDomain(mOversampler.factor());
+      mOsc.domain(d);
+      mAM.domain(d);
+      mAMEnv.domain(d);
+      mAmpEnv.domain(d);
+    }
+
     mAmpEnv.reset();
     mAMEnv.reset();
     // Map table number to table in memory
@@ -154,7 +178,9 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     virtual void onDraw(Graphics &g) override {
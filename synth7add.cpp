@@ -1,4 +1,5 @@
 
+#include <atomic>
 #include <cstdio>               // for printing to stdout
 #define GAMMA_H_INC_ALL         // define this to include all header files
 #define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
@@ -13,9 +14,27 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/PartialTracks.hpp"
+#include "dsp/SpectralAdditive.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+#include "engine/LodGovernor.hpp"
+#include "engine/VoiceAdmission.hpp"
+
 using namespace gam;
 using namespace al;
 
+// Partials of all AddSyn voices rendered with one inverse FFT per hop
+SpectralAdditive addBank {8192, 1024};
+std::atomic<bool> useAddBank {false};  // new notes use addBank instead of oscillators
+
+// Voices created up front; each takes its addBank slots in init()
+static const unsigned kPolyphony = 64;
+
+// Analysis by tools/partial_analyzer, played by notes with "resynth" on
+PartialTracks resynthTracks;
+
 class AddSyn : public SynthVoice {
 public:
 
@@ -33,7 +52,16 @@ public:
   ADSR<> mEnvLow;
   ADSR<> mEnvUp;
   Pan<> mPan;
-  EnvFollow<> mEnvFollow;
+  BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
+  AdmissionTicket mTicket;  // lets the admission controller delay or reject this voice
+  int mLod = 0;  // quality tier, latched at note on: 1 drops the upper partials, 2 also the lower
+  int mPartials = -1;  // first of our 9 slots in addBank
+  bool mSpectral = false;  // latched at note on from useAddBank
+  int mTrackPartials = -1;  // first of our slots for resynthTracks, one per lane
+  bool mResynth = false;  // playing resynthTracks, latched at note on
+  bool mStartPending = false;  // addBank phases and pans not yet reset for this note
+  float mTrackFrame = 0;  // analysis frame being played
+  std::vector<unsigned> mLaneCursor;  // current track index in each lane
 
   // Additional members
   Mesh mMesh;
@@ -54,6 +82,12 @@ public:
     mEnvUp.lengths(0.1, 0.1, 0.1);
     mEnvUp.sustain(2); // Make point 2 sustain until a release is issued
 
+    mTicket.voiceClass(admission().voiceClass("AddSyn"));
+    mPartials = addBank.allocate(9);
+    if (resynthTracks.numLanes() > 0) {
+      mTrackPartials = addBank.allocate(resynthTracks.numLanes());
+    }
+
     // We have the mesh be a sphere
     addDisc(mMesh, 1.0, 30);
 
@@ -81,9 +115,23 @@ public:
     createInternalTriggerParameter("freqUp3", 8.0, 0.1, 10);
     createInternalTriggerParameter("freqUp4", 9.0, 0.1, 10);
     createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+    createInternalTriggerParameter("resynth", 0, 0, 1); // 1: play resynthTracks through addBank
   }
 
   virtual void onProcess(AudioIOData& io) override {
+    if (!mTicket.beginBlock()) {
+      // Waiting for CPU headroom, or turned away
+      if (mTicket.rejected()) {
+        mTicket.finish();
+        free();
+      }
+      return;
+    }
+    if (mSpectral) {
+      if (mStartPending) startSpectral();
+      processSpectral(io);
+      return;
+    }
     // Parameters will update values once per audio callback
     float freq = getInternalParameterValue("freq");
     mOsc.freq(freq);
@@ -103,17 +151,24 @@ public:
     float amp = getInternalParameterValue("amp");
     while(io()){
       float s1 = (mOsc1() + mOsc2() + mOsc3()) * mEnvStri() * ampStri;
-      s1 += (mOsc4() + mOsc5()) * mEnvLow() * ampLow;
-      s1 += (mOsc6() + mOsc7() + mOsc8() + mOsc9()) * mEnvUp() * ampUp;
+      float envLow = mEnvLow(); // envelopes keep running so done() works at any tier
+      float envUp = mEnvUp();
+      if (mLod < 2) s1 += (mOsc4() + mOsc5()) * envLow * ampLow;
+      if (mLod < 1) s1 += (mOsc6() + mOsc7() + mOsc8() + mOsc9()) * envUp * ampUp;
       s1 *= amp;
       float s2;
-      mEnvFollow(s1);
+      mPeak(s1);
       mPan(s1, s1,s2);
       io.out(0) += s1;
       io.out(1) += s2;
     }
     //if(mEnvStri.done()) free();
-    if(mEnvStri.done() && mEnvUp.done() && mEnvLow.done() && (mEnvFollow.value() < 0.001)) free();
+    mPeak.endBlock();
+    bool yield = mTicket.endBlock(); // a new voice is taking our place
+    if(yield || (mEnvStri.done() && mEnvUp.done() && mEnvLow.done() && voiceRetirement().silent(mPeak.value()))) {
+      mTicket.finish();
+      free();
+    }
   }
 
   virtual void onTriggerOn() override {
@@ -138,13 +193,108 @@ public:
     mEnvStri.reset();
     mEnvLow.reset();
     mEnvUp.reset();
+
+    mLod = lod().tier();
+    mSpectral = useAddBank && mPartials >= 0;
+    mResynth = getInternalParameterValue("resynth") > 0.5f && mTrackPartials >= 0;
+    if (mResynth) {
+      mSpectral = true;
+      mTrackFrame = 0;
+      mLaneCursor.assign(resynthTracks.numLanes(), 0);
+    }
+    // addBank is read by the audio thread; its slots are set from there
+    mStartPending = mSpectral;
+    mTicket.request();
   }
 
   virtual void onTriggerOff() override {
     std::cout << "trigger off" <<std::endl;
+    mTicket.release();
     mEnvStri.triggerRelease();
     mEnvLow.triggerRelease();
     mEnvUp.triggerRelease();
+    // The note latched it at trigger on; don't let a pooled voice carry it
+    // into a later note that leaves it out
+    setInternalParameterValue("resynth", 0);
+  }
+
+  // Reset phases and set pans of this note's addBank slots; runs in the
+  // note's first block, on the audio thread
+  void startSpectral() {
+    float pan = getInternalParameterValue("pan");
+    for (int i = 0; i < 9; i++) {
+      addBank.phase(mPartials + i, 0);
+      addBank.pan(mPartials + i, pan);
+    }
+    for (unsigned l = 0; mResynth && l < resynthTracks.numLanes(); l++) {
+      addBank.phase(mTrackPartials + l, 0);
+      addBank.pan(mTrackPartials + l, pan);
+    }
+    mStartPending = false;
+  }
+
+  // Same partials and envelopes, but the partials are written to addBank
+  // once per block and the envelopes only sampled at the end of the block
+  void processSpectral(AudioIOData& io) {
+    float envStri = 0, envLow = 0, envUp = 0;
+    const int frames = io.framesPerBuffer() - io.frame(); // a voice may start mid-buffer
+    while(io()){
+      envStri = mEnvStri();
+      envLow = mEnvLow();
+      envUp = mEnvUp();
+    }
+    float freq = getInternalParameterValue("freq");
+    float amp = getInternalParameterValue("amp");
+    bool ended = false;
+    if (mResynth) {
+      // At amp 0.03, as in fillTime(), the analysis plays at its recorded level
+      float level = amp / 0.03f * envStri;
+      mPeak(playTracks(freq, level));
+      mTrackFrame += frames / (io.framesPerSecond() * resynthTracks.hop());
+      ended = mTrackFrame >= resynthTracks.numFrames();
+    } else {
+      float stri = amp * envStri * getInternalParameterValue("ampStri");
+      float low = mLod < 2 ? amp * envLow * getInternalParameterValue("ampLow") : 0;
+      float up = mLod < 1 ? amp * envUp * getInternalParameterValue("ampUp") : 0;
+      const char * ratios[9] = {"freqStri1", "freqStri2", "freqStri3", "freqLow1", "freqLow2",
+                                "freqUp1", "freqUp2", "freqUp3", "freqUp4"};
+      for (int i = 0; i < 9; i++) {
+        float a = i < 3 ? stri : (i < 5 ? low : up);
+        addBank.partial(mPartials + i, getInternalParameterValue(ratios[i]) * freq, a);
+      }
+      mPeak(3 * stri + 2 * low + 4 * up); // upper bound of the output level
+    }
+    mPeak.endBlock();
+    bool yield = mTicket.endBlock(); // a new voice is taking our place
+    if(yield || ended || (mEnvStri.done() && mEnvUp.done() && mEnvLow.done() && voiceRetirement().silent(mPeak.value()))) {
+      for (int i = 0; i < 9; i++) addBank.partial(mPartials + i, 0, 0);
+      for (unsigned l = 0; mResynth && l < resynthTracks.numLanes(); l++) {
+        addBank.partial(mTrackPartials + l, 0, 0);
+      }
+      mTicket.finish();
+      free();
+    }
+  }
+
+  // Set one addBank partial per lane from the track sounding in it at
+  // mTrackFrame; returns the sum of amplitudes
+  float playTracks(float freq, float level) {
+    const std::vector<PartialTrack>& tracks = resynthTracks.tracks();
+    float sum = 0;
+    for (unsigned l = 0; l < resynthTracks.numLanes(); l++) {
+      const std::vector<unsigned>& lane = resynthTracks.lane(l);
+      unsigned& c = mLaneCursor[l];
+      while (c < lane.size() && tracks[lane[c]].end() <= mTrackFrame) c++;
+      float a = 0, f = 0;
+      if (c < lane.size()) {
+        const PartialTrack& t = tracks[lane[c]];
+        a = resynthTracks.amplitude(t, mTrackFrame) * level;
+        f = t.ratio * freq;
+      }
+      addBank.partial(mTrackPartials + l, f, a);
+      sum += a;
+    }
+    return sum;
   }
 
 
@@ -230,6 +380,15 @@ public:
     initScaleToHarmonicSeries();
     initScaleTo12TET(110);
 
+    // Partials for notes with "resynth" on, written by tools/partial_analyzer
+    if (resynthTracks.load("synth7-data/partials.ptk")) {
+      std::cout << "partials.ptk: " << resynthTracks.numTracks() << " tracks in "
+                << resynthTracks.numLanes() << " lanes" << std::endl;
+    }
+    // Create the voices now, after the analysis is loaded: their init()
+    // takes addBank slots, which must not happen while audio runs
+    synthManager.synth().allocatePolyphony<AddSyn>(kPolyphony);
+
     // Play example sequence. Comment this line to start from scratch
     synthManager.synthSequencer().playSequence("synth7.synthSequence");
     synthManager.synthRecorder().verbose(true);
@@ -237,7 +396,13 @@ public:
 
   // The audio callback function. Called when audio hardware requires data
   virtual void onSound(AudioIOData &io) override {
+    DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+    admission().beginCallback();
     synthManager.render(io); // Render audio
+    addBank.render(io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+    voiceRetirement().observeMix(io); // Track mix level for voice retirement
+    admission().endCallback(io.framesPerBuffer(), io.framesPerSecond());
+    lod().update(admission().headroom()); // Pick quality tier for new notes
   }
 
   // The graphics callback function.
@@ -256,6 +421,12 @@ public:
     if (ImGui::Button("Chimes 12TET")) {
       fillTimeWith12TET(0,4, 0.0001, 0.0001, 0.0001, 0.1, 0.1, 0.1);
     }
+    bool addBankOn = useAddBank;
+    if (ImGui::Checkbox("IFFT engine", &addBankOn)) useAddBank = addBankOn;
+    ImGui::SameLine();
+    ImGui::Text("%u partials", addBank.numActive());
+    ImGui::Separator();
+    drawAdmission();
     ImGui::Separator();
     synthManager.drawSynthWidgets();
 
@@ -294,6 +465,22 @@ public:
     ParameterGUI::cleanup();
   }
 
+  // Show callback load and log admission decisions other than a plain admit
+  void drawAdmission() {
+    float budget = admission().budget();
+    if (ImGui::SliderFloat("CPU budget", &budget, 0.1f, 1.0f)) {
+      admission().budget(budget);
+    }
+    ImGui::Text("load %.2f  AddSyn %.1f us/block  quality tier %d",
+                admission().load(), admission().cost(0) * 1e6f, lod().tier());
+    VoiceAdmission::Event e;
+    while (admission().events().pop(e)) {
+      std::cout << admission().className(e.voiceClass) << " "
+                << VoiceAdmission::decisionName(e.decision)
+                << " load " << e.load << " predicted " << e.predicted << std::endl;
+    }
+  }
+
   void initScaleToHarmonicSeries() {
     for (int i=0;i<20;++i) {
       harmonicSeriesScale[i] = 100*i;
@@ -309,24 +496,24 @@ public:
   }
 
   float randomFrom12TET() {
-    int index = rnd::uni(0,20);
+    int index = deterministic().random().uni(0,20);
     // std::cout << "index " << index << " is " << myScale[index] << std::endl;
     return halfStepScale[index];
   }
 
   float randomFromHarmonicSeries() {
-      int index = rnd::uni(0,20);
+      int index = deterministic().random().uni(0,20);
       // std::cout << "index " << index << " is " << myScale[index] << std::endl;
       return harmonicSeriesScale[index];
   }
 
   void fillTime(float from, float to, float minattackStri, float minattackLow, float minattackUp, float maxattackStri, float maxattackLow, float maxattackUp, float minFreq, float maxFreq) {
         while (from <= to) {
-            float nextAtt = rnd::uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
+            float nextAtt = deterministic().random().uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
             auto *voice = synthManager.synth().getVoice<AddSyn>();
-            voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0});
+            voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0, 0});
             voice->setInternalParameterValue("attackStr", nextAtt);
-            voice->setInternalParameterValue("freq", rnd::uni(minFreq,maxFreq));
+            voice->setInternalParameterValue("freq", deterministic().random().uni(minFreq,maxFreq));
             synthManager.synthSequencer().addVoiceFromNow(voice, from, 0.2);
             std::cout << "old from " << from << " plus nextnextAtt " << nextAtt << std::endl;
             from += nextAtt;
@@ -336,9 +523,9 @@ public:
   void fillTimeWith12TET(float from, float to, float minattackStri, float minattackLow, float minattackUp, float maxattackStri, float maxattackLow, float maxattackUp) {
       while (from <= to) {
 
-        float nextAtt = rnd::uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
+        float nextAtt = deterministic().random().uni((minattackStri+minattackLow+minattackUp),(maxattackStri+maxattackLow+maxattackUp));
         auto *voice = synthManager.synth().getVoice<AddSyn>();
-        voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0});
+        voice->setTriggerParams({0.03,440, 0.5,0.0001,3.8,0.3,   0.4,0.0001,6.0,0.99,  0.3,0.0001,6.0,0.9,  2,3,4.07,0.56,0.92,1.19,1.7,2.75,3.36, 0.0, 0});
         voice->setInternalParameterValue("attackStr", nextAtt);
         voice->setInternalParameterValue("freq", randomFrom12TET());
         synthManager.synthSequencer().addVoiceFromNow(voice, from, 0.2);
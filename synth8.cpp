@@ -19,6 +19,14 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/BlockNoise.hpp"
+#include "dsp/ControlReson.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+#include "engine/Deterministic.hpp"
+#include "engine/LodGovernor.hpp"
+#include "engine/VoiceAdmission.hpp"
+
 //using namespace gam;
 using namespace al;
 
@@ -29,10 +37,11 @@ public:
     float mNoiseMix;
     gam::Pan<> mPan;
     gam::ADSR<> mAmpEnv;
-    gam::EnvFollow<> mEnvFollow;  // envelope follower to connect audio output to graphics
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
     gam::DSF<> mOsc;
-    gam::NoiseWhite<> mNoise;
-    gam::Reson<> mRes;
+    BlockNoise mNoise;     // white noise, generated a block at a time
+    ControlReson<> mRes;   // Reson with control-rate coefficient updates
+    int mLod = 0;          // quality tier, latched at note on; halves hmnum per tier
     gam::Env<2> mCFEnv;
     gam::Env<2> mBWEnv;
     // Additional members
@@ -45,6 +54,7 @@ public:
         mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
         mCFEnv.curve(0);
         mBWEnv.curve(0);
+        mRes.period(16); // recompute filter coefficients every 16 samples
         mOsc.harmonics(12);
         // We have the mesh be a sphere
         addDisc(mMesh, 1.0, 30);
@@ -79,21 +89,25 @@ public:
             // mix oscillator with noise
             float s1 = mOsc()*(1-noiseMix) + mNoise()*noiseMix;
 
-            // apply resonant filter
+            // apply resonant filter (set() only latches the target,
+            // coefficients are updated at control rate)
             mRes.set(mCFEnv(), mBWEnv());
             s1 = mRes(s1);
+            COUNT_SUBNORMALS("Sub", s1); // debug builds only, see engine/Denormals.hpp
 
             // appy amplitude envelope
             s1 *= mAmpEnv() * amp;
 
             float s2;
+            mPeak(s1);
             mPan(s1, s1,s2);
             io.out(0) += s1;
             io.out(1) += s2;
         }
         
         
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001f)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
  /*   virtual void onProcess(Graphics &g) {
@@ -102,16 +116,19 @@ public:
         g.pushMatrix();
         g.translate(amplitude,  amplitude, -4);
         g.scale(frequency/200, frequency/400, 1);
-        g.color(mEnvFollow.value(), frequency/1000, mEnvFollow.value()* 10, 0.4);
+        g.color(mPeak.value(), frequency/1000, mPeak.value()* 10, 0.4);
         g.draw(mMesh);
         g.popMatrix();
     }
 */
     virtual void onTriggerOn() override {
+        mLod = lod().tier();
         updateFromParameters();
         mAmpEnv.reset();
         mCFEnv.reset();
         mBWEnv.reset();
+        mRes.zero();
+        if(deterministic().enabled()) mNoise.seed(deterministic().voiceSeed(id()));
         
     }
 
@@ -123,7 +140,7 @@ public:
 
     void updateFromParameters() {
         mOsc.freq(getInternalParameterValue("frequency"));
-        mOsc.harmonics(getInternalParameterValue("hmnum"));
+        mOsc.harmonics(getInternalParameterValue("hmnum") / (1 << mLod));
         mOsc.ampRatio(getInternalParameterValue("hmamp"));
         mAmpEnv.attack(getInternalParameterValue("attackTime"));
     //    mAmpEnv.decay(getInternalParameterValue("attackTime"));
@@ -164,7 +181,12 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        admission().beginCallback();
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
+        admission().endCallback(io.framesPerBuffer(), io.framesPerSecond());
+        lod().update(admission().headroom()); // Pick quality tier for new notes
     }
 
     virtual void onDraw(Graphics &g) override {
@@ -0,0 +1,234 @@
+/*    Gamma - Generic processing library
+    See COPYRIGHT file for authors and license information
+
+    Example:        Synth 9 Sampler
+    Description:    Plays long sound files streamed from disk. Every WAV file
+                    in synth9-data/samples is loaded at start up (only its
+                    first frames are kept in memory) and is chosen with the
+                    "sample" parameter, in alphabetical order. Files should
+                    be at the audio rate, 48 kHz.
+*/
+
+#include <algorithm>
+#include <cstdio>               // for printing to stdout
+#include <dirent.h>
+#define GAMMA_H_INC_ALL         // define this to include all header files
+#define GAMMA_H_NO_IO           // define this to avoid bringing AudioIO from Gamma
+
+#include "Gamma/Gamma.h"
+#include "Gamma/Types.h"
+
+#include "al/core/app/al_App.hpp"
+#include "al/core/graphics/al_Shapes.hpp"
+#include "al/util/ui/al_Parameter.hpp"
+#include "al/util/scene/al_PolySynth.hpp"
+#include "al/util/scene/al_SynthSequencer.hpp"
+#include "al/util/ui/al_ControlGUI.hpp"
+
+#include "dsp/SampleStreamer.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+
+using namespace al;
+
+// Voices created up front; each takes one stream
+static const unsigned kPolyphony = 32;
+
+// Sound files and the thread that reads them ahead of the voices, with a
+// stream for every voice plus the GUI manager's own
+SampleStreamer streamer {48000, kPolyphony + 1};
+
+class Sampler : public SynthVoice {
+public:
+
+    SampleStream * mStream = nullptr;
+    std::vector<float> mL, mR;  // one block of the sample
+    gam::ADSR<> mAmpEnv;
+    float mGainL = 1, mGainR = 1;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
+
+    // Additional members
+    Mesh mMesh;
+
+    virtual void init() {
+        mStream = streamer.newStream();
+        // Buffers grow on the audio thread only for blocks over 4096 samples
+        mL.resize(4096);
+        mR.resize(4096);
+
+        mAmpEnv.curve(0); // make segments lines
+        mAmpEnv.levels(0,1,1,0);
+        mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
+
+        addDisc(mMesh, 1.0, 30);
+
+        createInternalTriggerParameter("amplitude", 0.5, 0.0, 1.0);
+        createInternalTriggerParameter("sample", 0, 0, 63);
+        createInternalTriggerParameter("attackTime", 0.01, 0.01, 10.0);
+        createInternalTriggerParameter("releaseTime", 1.0, 0.01, 20.0);
+        createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+    }
+
+    virtual void onProcess(AudioIOData& io) override {
+        // A note starting mid-block plays from its offset on
+        unsigned n = io.framesPerBuffer() - io.frame();
+        if(mL.size() < n){ mL.resize(n); mR.resize(n); }
+        // Past the end of the sample read() leaves the buffers short
+        unsigned got = mStream->read(mL.data(), mR.data(), n);
+        std::fill(mL.begin() + got, mL.begin() + n, 0.f);
+        std::fill(mR.begin() + got, mR.begin() + n, 0.f);
+
+        float amp = getInternalParameterValue("amplitude");
+        unsigned i = 0;
+        while(io()){
+            float env = mAmpEnv() * amp;
+            float s1 = mL[i] * env * mGainL;
+            float s2 = mR[i] * env * mGainR;
+            ++i;
+            mPeak(s1);
+            mPeak(s2);
+            io.out(0) += s1;
+            io.out(1) += s2;
+        }
+        mPeak.endBlock();
+        bool done = !mStream->playing()
+                 || (mAmpEnv.done() && voiceRetirement().silent(mPeak.value()));
+        if(done){
+            mStream->stop();
+            free();
+        }
+    }
+
+    virtual void onProcess(Graphics &g) {
+        float sample = getInternalParameterValue("sample");
+        float amplitude = getInternalParameterValue("amplitude");
+        g.pushMatrix();
+        g.translate(getInternalParameterValue("pan"), amplitude, -4);
+        g.scale(0.2 + mPeak.value(), 0.2 + mPeak.value(), 1);
+        g.color(mPeak.value(), sample/16, 1 - sample/16, 0.4);
+        g.draw(mMesh);
+        g.popMatrix();
+    }
+
+    virtual void onTriggerOn() override {
+        mAmpEnv.attack(getInternalParameterValue("attackTime"));
+        mAmpEnv.decay(getInternalParameterValue("attackTime"));
+        mAmpEnv.release(getInternalParameterValue("releaseTime"));
+        mAmpEnv.reset();
+
+        // Balance rather than pan so stereo recordings keep their image
+        float pan = getInternalParameterValue("pan");
+        mGainL = pan > 0 ? 1 - pan : 1;
+        mGainR = pan < 0 ? 1 + pan : 1;
+
+        // Unknown sample numbers give a voice that frees itself at once
+        mStream->start(streamer.sample(unsigned(getInternalParameterValue("sample"))));
+    }
+
+    virtual void onTriggerOff() override {
+        mAmpEnv.triggerRelease();
+    }
+};
+
+
+// We make an app.
+class MyApp : public App
+{
+public:
+
+    virtual void onInit( ) override {
+        // Load every WAV file in the samples folder, sorted by name
+        std::string dir = "synth9-data/samples/";
+        std::vector<std::string> files;
+        if(DIR * d = opendir(dir.c_str())){
+            while(dirent * e = readdir(d)){
+                std::string name = e->d_name;
+                if(name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) files.push_back(name);
+            }
+            closedir(d);
+        }
+        std::sort(files.begin(), files.end());
+        for(auto& f : files){
+            if(streamer.load(dir + f)) std::printf("sample %u: %s\n", streamer.numSamples() - 1, f.c_str());
+        }
+        if(files.empty()) std::printf("No .wav files in %s\n", dir.c_str());
+    }
+
+    virtual void onCreate() override {
+        ParameterGUI::initialize();
+        synthManager.synthRecorder().verbose(true);
+        // Create the voices now: a voice created during playback would run
+        // init(), which takes a stream and allocates, on the audio thread
+        synthManager.synth().allocatePolyphony<Sampler>(kPolyphony);
+    }
+
+    virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
+        synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
+    }
+
+    virtual void onDraw(Graphics &g) override {
+        g.clear();
+        synthManager.render(g);
+
+        // Draw GUI
+        ParameterGUI::beginDraw();
+        ParameterGUI::beginPanel(synthManager.name());
+        ImGui::Text("%u samples, %u underruns", streamer.numSamples(), streamer.underruns());
+        ImGui::Separator();
+        synthManager.drawSynthWidgets();
+        ParameterGUI::endPanel();
+        ParameterGUI::endDraw();
+    }
+
+    virtual void onKeyDown(Keyboard const& k) override {
+      if (ParameterGUI::usingKeyboard()) { //Ignore keys if GUI is using them
+        return;
+      }
+        if (k.shift()) {
+            // If shift pressed then keyboard sets preset
+            int presetNumber = asciiToIndex(k.key());
+            synthManager.recallPreset(presetNumber);
+        } else {
+            // Otherwise each key plays the next sample
+            int midiNote = asciiToMIDI(k.key());
+            if (midiNote > 0 && streamer.numSamples() > 0) {
+              synthManager.voice()->setInternalParameterValue("sample", midiNote % streamer.numSamples());
+              synthManager.triggerOn(midiNote);
+            }
+        }
+    }
+
+    virtual void onKeyUp(Keyboard const& k) override {
+        int midiNote = asciiToMIDI(k.key());
+        if (midiNote > 0) {
+            synthManager.triggerOff(midiNote);
+        }
+    }
+
+    void onExit() override {
+        ParameterGUI::cleanup();
+    }
+
+    // GUI manager for Sampler voices
+    // The name provided determines the name of the directory
+    // where the presets and sequences are stored
+    SynthGUIManager<Sampler> synthManager {"synth9"};
+};
+
+
+int main(){    // Create app instance
+    MyApp app;
+
+    app.navControl().active(false); // Disable navigation via keyboard, since we will be using keyboard for note triggering
+
+    // Set up audio
+    app.initAudio(48000., 256, 2, 0);
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(app.audioIO().framesPerSecond());
+    app.audioIO().print();
+
+    app.start();
+    return 0;
+}
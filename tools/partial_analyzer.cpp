@@ -0,0 +1,334 @@
+/*    Synthesis tutorial - tools
+
+    File:           partial_analyzer.cpp
+    Description:    Find the partials of a sound file for resynthesis by
+                    AddSyn.
+
+    Usage:
+
+        partial_analyzer in.wav out.ptk [options]
+
+            --fft N         FFT size, a power of two (default 4096)
+            --hop N         samples between frames (default 512)
+            --peaks N       most peaks kept per frame (default 64)
+            --floor dB      ignore peaks below this level (default -90)
+            --min N         drop tracks shorter than N frames (default 4)
+            --f0 Hz         fundamental for the frequency ratios (default:
+                            the loudest track)
+            --threads N     worker threads (default: all cores)
+
+        partial_analyzer --check
+
+            analyze a generated 440 Hz + 1320 Hz sine, load the output back
+            and compare its partials with the generated ones
+
+    Build from the repository folder, without allolib:
+
+        c++ -O2 -std=c++14 -pthread -I. tools/partial_analyzer.cpp -o partial_analyzer
+
+    The channels are mixed to mono. Each frame is windowed (Hann) and
+    transformed, and its spectral peaks are refined by parabolic
+    interpolation. Frames are independent, so they are split into one
+    contiguous range per thread and every thread reads its samples straight
+    from the file. Peaks are then joined into tracks frame by frame: each
+    peak, loudest first, continues the nearest track within 3% (or one bin)
+    in frequency; tracks missing for more than two frames end.
+
+    Copy the output to bin/synth7-data/partials.ptk to play it with AddSyn.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "dsp/FFT.hpp"
+#include "dsp/PartialTracks.hpp"
+#include "dsp/SampleStreamer.hpp"
+
+struct Peak {
+    float freq;     // Hz
+    float amp;      // linear amplitude of the sinusoid
+};
+
+struct Options {
+    unsigned fft = 4096, hop = 512, peaks = 64, minLength = 4, threads = 0;
+    float floor = -90, f0 = 0;
+};
+
+// Peaks of frames [begin, end)
+static void analyzeFrames(const WavReader& wav, const Options& o, uint32_t begin, uint32_t end,
+                          std::vector<std::vector<Peak>>& peaks)
+{
+    const unsigned N = o.fft, ch = wav.channels();
+    const float sr = wav.sampleRate();
+    FFT fft(N);
+    std::vector<FFT::Complex> X(N);
+    std::vector<float> window(N), raw(N * ch), mag(N/2 + 1), db(N/2 + 1);
+    float wsum = 0;
+    for(unsigned n=0; n<N; ++n){
+        window[n] = 0.5f - 0.5f * std::cos(2 * M_PI * n / N);
+        wsum += window[n];
+    }
+    const float floorAmp = std::pow(10.f, o.floor / 20.f);
+    std::vector<Peak> found;
+
+    for(uint32_t f=begin; f<end; ++f){
+        // Frame f is centered on sample f * hop
+        int64_t first = int64_t(f) * o.hop - N/2;
+        std::fill(raw.begin(), raw.end(), 0.f);
+        uint64_t from = first < 0 ? 0 : uint64_t(first);
+        unsigned skip = unsigned(from - first);
+        wav.read(from, raw.data() + skip * ch, N - skip);
+        for(unsigned n=0; n<N; ++n){
+            float s = 0;
+            for(unsigned c=0; c<ch; ++c) s += raw[n * ch + c];
+            X[n] = FFT::Complex(s / ch * window[n], 0.f);
+        }
+        fft.forward(X.data());
+
+        // A sinusoid of amplitude a gives a peak of a * wsum / 2
+        for(unsigned k=0; k<=N/2; ++k){
+            mag[k] = std::abs(X[k]) * 2.f / wsum;
+            db[k] = 20.f * std::log10(mag[k] + 1e-20f);
+        }
+        found.clear();
+        for(unsigned k=1; k<N/2; ++k){
+            if(mag[k] > floorAmp && mag[k] > mag[k-1] && mag[k] >= mag[k+1]){
+                float a = db[k-1], b = db[k], c = db[k+1];
+                float d = a - 2*b + c;
+                float p = d < 0 ? 0.5f * (a - c) / d : 0.f;
+                float peakDb = b - 0.25f * (a - c) * p;
+                found.push_back({(k + p) * sr / N, std::pow(10.f, peakDb / 20.f)});
+            }
+        }
+        if(found.size() > o.peaks){
+            std::partial_sort(found.begin(), found.begin() + o.peaks, found.end(),
+                              [](const Peak& x, const Peak& y){ return x.amp > y.amp; });
+            found.resize(o.peaks);
+        }
+        peaks[f] = found;
+    }
+}
+
+// Join peaks of consecutive frames into tracks
+static std::vector<PartialTrack> trackPeaks(std::vector<std::vector<Peak>>& peaks, const Options& o,
+                                            float binHz, std::vector<std::vector<float>>& freqs,
+                                            std::vector<std::vector<float>>& amps)
+{
+    struct Active { unsigned track; float freq; unsigned missing; };
+    std::vector<Active> active;
+    std::vector<uint32_t> starts;
+    const unsigned kMaxGap = 2;
+
+    for(uint32_t f=0; f<peaks.size(); ++f){
+        std::vector<Peak>& frame = peaks[f];
+        std::sort(frame.begin(), frame.end(), [](const Peak& x, const Peak& y){ return x.amp > y.amp; });
+        std::vector<bool> taken(active.size(), false);
+        for(const Peak& p : frame){
+            int best = -1;
+            float bestDist = std::max(0.03f * p.freq, binHz);
+            for(unsigned i=0; i<active.size(); ++i){
+                float dist = std::fabs(active[i].freq - p.freq);
+                if(!taken[i] && dist < bestDist){ best = i; bestDist = dist; }
+            }
+            if(best >= 0){
+                Active& a = active[best];
+                taken[best] = true;
+                // Fill a gap with silence at the last frequency
+                while(starts[a.track] + amps[a.track].size() < f){
+                    amps[a.track].push_back(0.f);
+                    freqs[a.track].push_back(a.freq);
+                }
+                amps[a.track].push_back(p.amp);
+                freqs[a.track].push_back(p.freq);
+                a.freq = p.freq;
+                a.missing = 0;
+            } else {
+                starts.push_back(f);
+                freqs.push_back({p.freq});
+                amps.push_back({p.amp});
+                active.push_back({unsigned(starts.size() - 1), p.freq, 0});
+                taken.push_back(true);
+            }
+        }
+        for(unsigned i=0; i<active.size(); ){
+            if(!taken[i] && ++active[i].missing > kMaxGap){
+                active[i] = active.back();
+                taken[i] = taken.back();
+                active.pop_back();
+                taken.pop_back();
+            }
+            else ++i;
+        }
+    }
+
+    std::vector<PartialTrack> tracks;
+    for(unsigned t=0; t<starts.size(); ++t){
+        if(amps[t].size() < o.minLength) continue;
+        PartialTrack p;
+        p.start = starts[t];
+        p.ratio = 0;    // mean frequency for now, ratio once f0 is known
+        float wsum = 0;
+        for(unsigned i=0; i<amps[t].size(); ++i){
+            p.ratio += freqs[t][i] * amps[t][i];
+            wsum += amps[t][i];
+        }
+        p.ratio /= wsum;
+        p.amps.resize(amps[t].size());  // encoded once the peak is known
+        tracks.push_back(std::move(p));
+        // Compact the kept tracks' amplitudes to the front; moving a
+        // vector onto itself would empty it
+        if(tracks.size() - 1 != t) amps[tracks.size() - 1] = std::move(amps[t]);
+    }
+    amps.resize(tracks.size());
+    return tracks;
+}
+
+static bool parse(int argc, char ** argv, Options& o){
+    for(int i=3; i<argc; i+=2){
+        if(i+1 >= argc) return false;
+        const char * k = argv[i];
+        double v = std::atof(argv[i+1]);
+        if(!std::strcmp(k, "--fft")) o.fft = unsigned(v);
+        else if(!std::strcmp(k, "--hop")) o.hop = unsigned(v);
+        else if(!std::strcmp(k, "--peaks")) o.peaks = unsigned(v);
+        else if(!std::strcmp(k, "--floor")) o.floor = float(v);
+        else if(!std::strcmp(k, "--min")) o.minLength = unsigned(v);
+        else if(!std::strcmp(k, "--f0")) o.f0 = float(v);
+        else if(!std::strcmp(k, "--threads")) o.threads = unsigned(v);
+        else return false;
+    }
+    return o.fft >= 64 && (o.fft & (o.fft-1)) == 0 && o.hop > 0 && o.peaks > 0;
+}
+
+// Analyze inPath and write the tracks to outPath; returns 0 on success
+static int analyze(const char * inPath, const char * outPath, const Options& o){
+    WavReader wav;
+    if(!wav.open(inPath)){
+        std::printf("could not read %s\n", inPath);
+        return 1;
+    }
+
+    uint32_t numFrames = uint32_t(wav.frames() / o.hop + 1);
+    unsigned threads = o.threads ? o.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%s: %.1f s, %u frames on %u threads\n", inPath,
+                double(wav.frames()) / wav.sampleRate(), numFrames, threads);
+
+    std::vector<std::vector<Peak>> peaks(numFrames);
+    std::vector<std::thread> workers;
+    for(unsigned t=0; t<threads; ++t){
+        uint32_t begin = uint64_t(numFrames) * t / threads;
+        uint32_t end = uint64_t(numFrames) * (t+1) / threads;
+        workers.emplace_back(analyzeFrames, std::cref(wav), std::cref(o), begin, end, std::ref(peaks));
+    }
+    for(auto& w : workers) w.join();
+
+    std::vector<std::vector<float>> freqs, amps;
+    std::vector<PartialTrack> tracks = trackPeaks(peaks, o, float(wav.sampleRate()) / o.fft, freqs, amps);
+    if(tracks.empty()){
+        std::printf("no partials found above %g dB\n", o.floor);
+        return 1;
+    }
+
+    // Fundamental: given, or the loudest track's frequency
+    float f0 = o.f0, peak = 0, loudest = -1;
+    for(unsigned t=0; t<tracks.size(); ++t){
+        float energy = 0;
+        for(float a : amps[t]){ energy += a * a; peak = std::max(peak, a); }
+        if(energy > loudest){ loudest = energy; if(o.f0 <= 0) f0 = tracks[t].ratio; }
+    }
+
+    PartialTracks out;
+    out.set({}, numFrames, float(o.hop) / wav.sampleRate(), f0, peak);
+    for(unsigned t=0; t<tracks.size(); ++t){
+        tracks[t].ratio /= f0;
+        for(unsigned i=0; i<amps[t].size(); ++i) tracks[t].amps[i] = out.encode(amps[t][i]);
+    }
+    out.set(std::move(tracks), numFrames, float(o.hop) / wav.sampleRate(), f0, peak);
+    if(!out.save(outPath)){
+        std::printf("could not write %s\n", outPath);
+        return 1;
+    }
+    std::printf("%u tracks in %u lanes, f0 %.2f Hz, written to %s\n",
+                out.numTracks(), out.numLanes(), f0, outPath);
+    return 0;
+}
+
+// Write a mono 16-bit WAV of amplitude a1 at f1 plus a2 at f2
+static bool writeTestWav(const std::string& path, float f1, float a1, float f2, float a2,
+                         unsigned sampleRate, unsigned frames)
+{
+    FILE * f = std::fopen(path.c_str(), "wb");
+    if(!f) return false;
+    auto u32 = [f](uint32_t v){ unsigned char b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)}; std::fwrite(b, 1, 4, f); };
+    auto u16 = [f](uint16_t v){ unsigned char b[2] = {uint8_t(v), uint8_t(v >> 8)}; std::fwrite(b, 1, 2, f); };
+    std::fwrite("RIFF", 1, 4, f); u32(36 + frames * 2); std::fwrite("WAVE", 1, 4, f);
+    std::fwrite("fmt ", 1, 4, f); u32(16); u16(1); u16(1); u32(sampleRate); u32(sampleRate * 2); u16(2); u16(16);
+    std::fwrite("data", 1, 4, f); u32(frames * 2);
+    for(unsigned i=0; i<frames; ++i){
+        double t = double(i) / sampleRate;
+        double s = a1 * std::sin(2 * M_PI * f1 * t) + a2 * std::sin(2 * M_PI * f2 * t);
+        u16(uint16_t(int16_t(std::lround(s * 32767))));
+    }
+    return std::fclose(f) == 0;
+}
+
+// Round trip: analyze a known sound, load the file back and check that
+// its partials have the frequencies and levels that were generated
+static int check(){
+    const float f1 = 440, a1 = 0.5f, f2 = 1320, a2 = 0.25f;
+    std::string base = "/tmp/partial_analyzer-check-" + std::to_string(getpid());
+    std::string wavPath = base + ".wav", ptkPath = base + ".ptk";
+    if(!writeTestWav(wavPath, f1, a1, f2, a2, 44100, 44100)){
+        std::printf("check: could not write %s\n", wavPath.c_str());
+        return 1;
+    }
+    Options o;
+    int result = analyze(wavPath.c_str(), ptkPath.c_str(), o);
+    PartialTracks tracks;
+    if(result == 0 && !tracks.load(ptkPath)) result = 1;
+    std::remove(wavPath.c_str());
+    std::remove(ptkPath.c_str());
+    if(result) return result;
+
+    // Loudest amplitude of the track nearest a frequency ratio, away from
+    // the edges of the file
+    auto level = [&](float ratio){
+        const PartialTrack * best = nullptr;
+        for(auto& p : tracks.tracks()){
+            if(!best || std::fabs(p.ratio - ratio) < std::fabs(best->ratio - ratio)) best = &p;
+        }
+        float a = 0;
+        if(best && std::fabs(best->ratio - ratio) < 0.01f * ratio){
+            a = tracks.amplitude(*best, tracks.numFrames() / 2.f);
+        }
+        return a;
+    };
+    bool ok = std::fabs(tracks.f0() - f1) < 0.5f;
+    float l1 = level(1), l2 = level(f2 / f1);
+    // Amplitudes are stored in half-decibel steps
+    ok &= std::fabs(20 * std::log10(l1 / a1 + 1e-20f)) < 0.5f;
+    ok &= std::fabs(20 * std::log10(l2 / a2 + 1e-20f)) < 0.5f;
+    std::printf("check: f0 %.2f Hz (%g), levels %.4f (%g), %.4f (%g): %s\n",
+                tracks.f0(), f1, l1, a1, l2, a2, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char ** argv){
+    if(argc == 2 && !std::strcmp(argv[1], "--check")) return check();
+    Options o;
+    if(argc < 3 || !parse(argc, argv, o)){
+        std::printf("usage: %s in.wav out.ptk [--fft N] [--hop N] [--peaks N] [--floor dB]"
+                    " [--min N] [--f0 Hz] [--threads N]\n"
+                    "       %s --check\n", argv[0], argv[0]);
+        return 1;
+    }
+    return analyze(argv[1], argv[2], o);
+}
@@ -19,6 +19,10 @@
 #include "al/util/scene/al_SynthSequencer.hpp"
 #include "al/util/ui/al_ControlGUI.hpp"
 
+#include "dsp/Fused.hpp"
+#include "dsp/VoiceRetirement.hpp"
+#include "engine/Denormals.hpp"
+
 using namespace gam;
 using namespace al;
 
@@ -37,7 +41,7 @@ public:
   gam::ADSR<> mAMEnv;
   gam::Sine<> mOsc;
   gam::ADSR<> mAmpEnv;
-  EnvFollow<> mEnvFollow;
+  BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
   Pan<> mPan;
 
   Mesh mMesh;
@@ -69,26 +73,30 @@ public:
   virtual void onProcess(AudioIOData& io) override {
     mOsc.freq(getInternalParameterValue("frequency"));
 
-    float amp = getInternalParameterValue("amplitude");
-    float amRatio = getInternalParameterValue("amRatio");
-    while(io()){
-
-      mAM.freq(mOsc.freq()*amRatio);            // set AM freq according to ratio
-      float amAmt = mAMEnv();                    // AM amount envelope
+    mAM.freq(mOsc.freq()*getInternalParameterValue("amRatio")); // set AM freq according to ratio
 
-      float s1 = mOsc();                        // non-modulated signal
-      s1 = s1*(1-amAmt) + (s1*mAM())*amAmt;    // mix modulated and non-modulated
-
-      s1 *= mAmpEnv() *amp;
+    float amp = getInternalParameterValue("amplitude");
 
+    // The signal graph, evaluated as one fused loop per chunk of samples
+    auto osc = fused::gen(mOsc);                // non-modulated signal
+    auto am = fused::gen(mAM);
+    auto amAmt = fused::gen(mAMEnv);            // AM amount envelope
+    auto env = fused::gen(mAmpEnv);
+    // mix modulated and non-modulated, then apply amplitude envelope, over
+    // the frames from the voice's offset on
+    auto out = fused::stream((osc*(1.f-amAmt) + osc*am*amAmt) * env * amp,
+                             io.framesPerBuffer() - io.frame());
+    while(io()){
+      float s1 = out();
       float s2;
-      mEnvFollow(s1);
+      mPeak(s1);
       mPan(s1, s1,s2);
       io.out(0) += s1;
       io.out(1) += s2;
     }
     //if(mAmpEnv.done()) free();
-    if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+    mPeak.endBlock();
+    if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
   }
 
   virtual void onTriggerOn() override {
@@ -136,7 +144,7 @@ public:
     gam::Pan<> mPan;
     gam::ADSR<> mAmpEnv;
     gam::ADSR<> mModEnv;
-    gam::EnvFollow<> mEnvFollow;
+    BlockPeak mPeak;  // output peak per block, for voice retirement and graphics
 
     gam::Sine<> car, mod;    // carrier, modulator sine oscillators
 
@@ -178,12 +186,13 @@ public:
           car.freq(carBaseFreq + mod()*mModEnv()*modScale);
           float s1 = car() * mAmpEnv() * amp;
           float s2;
-          mEnvFollow(s1);
+          mPeak(s1);
           mPan(s1, s1,s2);
           io.out(0) += s1;
           io.out(1) += s2;
         }
-        if(mAmpEnv.done() && (mEnvFollow.value() < 0.001)) free();
+        mPeak.endBlock();
+        if(mAmpEnv.done() && voiceRetirement().silent(mPeak.value())) free();
     }
 
     virtual void onProcess(Graphics &g) {
@@ -191,7 +200,7 @@ public:
         g.translate(getInternalParameterValue("freq")/ 300 - 2,  getInternalParameterValue("modAmt")/25-1, -4);
         float scaling = getInternalParameterValue("amplitude")*1;
         g.scale(scaling, scaling , scaling* 1);
-        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mEnvFollow.value()* 10));
+        g.color(HSV( getInternalParameterValue("modMul")/20, 1, mPeak.value()* 10));
         g.draw(mMesh);
         g.popMatrix();
     }
@@ -259,7 +268,9 @@ public:
     }
 
     virtual void onSound(AudioIOData &io) override {
+        DenormalGuard noDenormals; // Flush subnormals to zero while rendering
         synthManager.render(io); // Render audio
+        voiceRetirement().observeMix(io); // Track mix level for voice retirement
     }
 
     virtual void onDraw(Graphics &g) override {